@@ -0,0 +1,456 @@
+#include "batch.h"
+
+#include <iostream>
+#include <filesystem>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include "decompiler.h"
+#include "xrefs.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <stdlib.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <cerrno>
+extern char** environ;
+#endif
+
+// Journal lines, tab separated since paths can have spaces in them:
+//   done   <file>
+//   failed <file> <function start, -1 if the file itself couldn't be loaded> <function name>
+static const char* kJournalName = "journal.txt";
+
+// Workers are started straight from their arguments, never through a shell, so file names can
+// contain anything
+struct WorkerProcess
+{
+	FILE* output = nullptr; // The worker's stdout
+#ifdef _WIN32
+	HANDLE process = nullptr;
+#else
+	pid_t pid = -1;
+#endif
+};
+
+#ifdef _WIN32
+// Quoted the way the C runtime splits the command line back into arguments
+static std::string QuoteArg( const std::string& arg )
+{
+	std::string quoted = "\"";
+	size_t backslashes = 0;
+	for( char c : arg )
+	{
+		if( c == '\\' )
+		{
+			backslashes++;
+			continue;
+		}
+
+		// Backslashes are only special in front of a quote
+		quoted.append( c == '"' ? backslashes * 2 + 1 : backslashes, '\\' );
+		quoted += c;
+		backslashes = 0;
+	}
+	quoted.append( backslashes * 2, '\\' );
+	return quoted + '"';
+}
+#endif
+
+static bool StartWorker( const std::vector<std::string>& args, WorkerProcess& worker )
+{
+	// Pipes have to be uninheritable before the next worker is started, otherwise it keeps the
+	// write end of another worker's pipe open and that worker's end is never seen
+	static std::mutex mutex;
+	std::lock_guard<std::mutex> lock( mutex );
+
+#ifdef _WIN32
+	SECURITY_ATTRIBUTES security = { sizeof( security ), nullptr, TRUE };
+	HANDLE read, write;
+	if( !CreatePipe( &read, &write, &security, 0 ) )
+		return false;
+	SetHandleInformation( read, HANDLE_FLAG_INHERIT, 0 );
+
+	std::string command_line;
+	for( const std::string& arg : args )
+		command_line += ( command_line.empty() ? "" : " " ) + QuoteArg( arg );
+
+	STARTUPINFOA startup = { sizeof( startup ) };
+	startup.dwFlags = STARTF_USESTDHANDLES;
+	startup.hStdInput = GetStdHandle( STD_INPUT_HANDLE );
+	startup.hStdOutput = write;
+	startup.hStdError = GetStdHandle( STD_ERROR_HANDLE );
+	PROCESS_INFORMATION info;
+	BOOL started = CreateProcessA( nullptr, command_line.data(), nullptr, nullptr, TRUE, 0, nullptr, nullptr, &startup, &info );
+	CloseHandle( write );
+	if( !started )
+	{
+		CloseHandle( read );
+		return false;
+	}
+
+	CloseHandle( info.hThread );
+	worker.process = info.hProcess;
+	worker.output = _fdopen( _open_osfhandle( (intptr_t)read, _O_RDONLY ), "r" );
+#else
+	int fds[2];
+	if( pipe( fds ) != 0 )
+		return false;
+	fcntl( fds[0], F_SETFD, FD_CLOEXEC );
+	fcntl( fds[1], F_SETFD, FD_CLOEXEC );
+
+	std::vector<char*> argv;
+	for( const std::string& arg : args )
+		argv.push_back( const_cast<char*>( arg.c_str() ) );
+	argv.push_back( nullptr );
+
+	// dup2 clears close-on-exec for the worker's stdout only
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init( &actions );
+	posix_spawn_file_actions_adddup2( &actions, fds[1], STDOUT_FILENO );
+	int error = posix_spawnp( &worker.pid, argv[0], &actions, nullptr, argv.data(), environ );
+	posix_spawn_file_actions_destroy( &actions );
+	close( fds[1] );
+	if( error != 0 )
+	{
+		close( fds[0] );
+		return false;
+	}
+
+	worker.output = fdopen( fds[0], "r" );
+#endif
+	return true;
+}
+
+// Waits for the worker to exit, returns true if it exited normally with 0
+static bool FinishWorker( WorkerProcess& worker )
+{
+	if( worker.output )
+		fclose( worker.output );
+
+#ifdef _WIN32
+	DWORD exit_code = 1;
+	WaitForSingleObject( worker.process, INFINITE );
+	GetExitCodeProcess( worker.process, &exit_code );
+	CloseHandle( worker.process );
+	return exit_code == 0;
+#else
+	int status = 0;
+	pid_t result;
+	while( ( result = waitpid( worker.pid, &status, 0 ) ) == -1 && errno == EINTR )
+		;
+	return result == worker.pid && WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+#endif
+}
+
+static void KillWorker( WorkerProcess& worker )
+{
+#ifdef _WIN32
+	TerminateProcess( worker.process, 1 );
+#else
+	kill( worker.pid, SIGKILL );
+#endif
+}
+
+// Kills the worker once it goes longer than the timeout without reporting anything. Killing it
+// closes its end of the pipe, so the supervisor stops reading and handles the function it was stuck
+// in like one it crashed in
+class Watchdog
+{
+public:
+	Watchdog( WorkerProcess& worker, std::chrono::milliseconds timeout ) :
+		worker_( &worker ),
+		timeout_( timeout ),
+		deadline_( std::chrono::steady_clock::now() + timeout )
+	{
+		if( timeout_.count() > 0 )
+			thread_ = std::thread( &Watchdog::Watch, this );
+	}
+	// Has to be stopped before the worker is waited for, so it can't kill a reused process id
+	~Watchdog()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			stopped_ = true;
+		}
+		changed_.notify_one();
+		if( thread_.joinable() )
+			thread_.join();
+	}
+
+	void Reset()
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		deadline_ = std::chrono::steady_clock::now() + timeout_;
+	}
+	bool fired()
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		return fired_;
+	}
+private:
+	void Watch()
+	{
+		std::unique_lock<std::mutex> lock( mutex_ );
+		while( !stopped_ )
+		{
+			if( std::chrono::steady_clock::now() >= deadline_ )
+			{
+				fired_ = true;
+				KillWorker( *worker_ );
+				return;
+			}
+			changed_.wait_until( lock, deadline_ );
+		}
+	}
+private:
+	WorkerProcess* worker_;
+	std::chrono::milliseconds timeout_;
+	std::thread thread_;
+
+	std::mutex mutex_; // Guards everything below
+	std::condition_variable changed_;
+	std::chrono::steady_clock::time_point deadline_;
+	bool stopped_ = false;
+	bool fired_ = false;
+};
+
+BatchSupervisor::BatchSupervisor( std::string worker_command, std::vector<std::string> worker_args, std::string out_dir,
+	unsigned int timeout_ms ) :
+	worker_command_( std::move( worker_command ) ),
+	worker_args_( std::move( worker_args ) ),
+	out_dir_( std::move( out_dir ) ),
+	timeout_ms_( timeout_ms )
+{}
+
+bool BatchSupervisor::Run( const std::vector<std::string>& files, unsigned int num_workers )
+{
+	std::error_code error;
+	std::filesystem::create_directories( out_dir_, error );
+
+	ReadJournal();
+	journal_.open( ( std::filesystem::path( out_dir_ ) / kJournalName ).string(), std::ios::app );
+	if( !journal_ )
+		return false;
+
+	// Files are handed out one at a time, they vary a lot in size
+	std::atomic<size_t> next_file( 0 );
+	auto Worker = [&]() {
+		for( size_t i = next_file++; i < files.size(); i = next_file++ )
+			ProcessFile( files[i] );
+	};
+
+	std::vector<std::thread> threads;
+	for( unsigned int i = 1; i < num_workers; i++ )
+		threads.emplace_back( Worker );
+	Worker();
+	for( std::thread& thread : threads )
+		thread.join();
+
+	return journal_.good();
+}
+
+void BatchSupervisor::ReadJournal()
+{
+	std::ifstream journal( ( std::filesystem::path( out_dir_ ) / kJournalName ).string() );
+	std::string line;
+	while( std::getline( journal, line ) )
+	{
+		size_t file_start = line.find( '\t' );
+		if( file_start == std::string::npos )
+			continue;
+
+		std::string kind = line.substr( 0, file_start );
+		size_t file_end = line.find( '\t', file_start + 1 );
+		std::string file = line.substr( file_start + 1, file_end == std::string::npos ? std::string::npos : file_end - file_start - 1 );
+		if( kind == "done" )
+			done_.insert( file );
+		else if( kind == "failed" && file_end != std::string::npos )
+			failed_[file].insert( (cell_t)strtol( line.c_str() + file_end + 1, nullptr, 10 ) );
+	}
+}
+
+void BatchSupervisor::Journal( const std::string& line )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	journal_ << line << '\n';
+	journal_.flush();
+}
+
+std::string BatchSupervisor::OutputPath( const std::string& file ) const
+{
+	// The whole path goes into the name, so files with the same name in different directories don't clash
+	std::string name = std::filesystem::path( file ).relative_path().string();
+	for( char& c : name )
+	{
+		if( c == '/' || c == '\\' || c == ':' )
+			c = '_';
+	}
+	return ( std::filesystem::path( out_dir_ ) / ( name + ".sp" ) ).string();
+}
+
+void BatchSupervisor::ProcessFile( const std::string& file )
+{
+	std::set<cell_t> skip;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( done_.count( file ) )
+		{
+			num_skipped_files_++;
+			return;
+		}
+		skip = failed_[file];
+	}
+
+	// Files that were only partly done are started over, functions known to fail are still skipped
+	std::string out_path = OutputPath( file );
+	std::ofstream( out_path, std::ios::trunc );
+
+	cell_t after = -1;
+	for( ;; )
+	{
+		std::vector<std::string> args = { worker_command_, "--batch-worker", file, "--out", out_path, "--after", std::to_string( after ) };
+		if( !skip.empty() )
+		{
+			std::string skip_list;
+			for( auto it = skip.begin(); it != skip.end(); ++it )
+				skip_list += ( it == skip.begin() ? "" : "," ) + std::to_string( *it );
+			args.push_back( "--skip" );
+			args.push_back( skip_list );
+		}
+		args.insert( args.end(), worker_args_.begin(), worker_args_.end() );
+
+		WorkerProcess worker;
+		if( !StartWorker( args, worker ) )
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			std::cout << "Could not start worker for " << file << std::endl;
+			return;
+		}
+
+		// Only the last function started matters, a worker that dies was stuck in it. The timeout
+		// restarts with every line, so it applies to each function on its own
+		bool in_function = false;
+		bool done = false;
+		bool timed_out;
+		cell_t current = -1;
+		std::string current_name;
+		char line[512];
+		{
+			Watchdog watchdog( worker, std::chrono::milliseconds( timeout_ms_ ) );
+			while( worker.output && fgets( line, sizeof( line ), worker.output ) )
+			{
+				watchdog.Reset();
+				line[strcspn( line, "\r\n" )] = '\0';
+
+				int start;
+				int name_start = 0;
+				if( sscanf( line, "begin %d %n", &start, &name_start ) == 1 )
+				{
+					in_function = true;
+					current = start;
+					current_name = name_start ? line + name_start : "";
+				}
+				else if( sscanf( line, "end %d", &start ) == 1 )
+				{
+					in_function = false;
+					after = start;
+				}
+				else if( strcmp( line, "done" ) == 0 )
+				{
+					done = true;
+				}
+			}
+			timed_out = watchdog.fired();
+		}
+		bool exited = FinishWorker( worker );
+
+		if( done && exited )
+			break;
+
+		if( !in_function )
+		{
+			// Died without being in any function, most likely the file itself is broken
+			Journal( "failed\t" + file + "\t-1\t" );
+			std::lock_guard<std::mutex> lock( mutex_ );
+			num_failed_functions_++;
+			std::cout << "Worker " << ( timed_out ? "timed out" : "failed" ) << " on " << file << std::endl;
+			break;
+		}
+
+		Journal( "failed\t" + file + "\t" + std::to_string( current ) + "\t" + current_name );
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			num_failed_functions_++;
+			std::cout << "Worker " << ( timed_out ? "timed out" : "failed" ) << " on " << file << ": " << current_name << std::endl;
+		}
+
+		std::ofstream( out_path, std::ios::app ) << "// " << current_name << ": decompiler " << ( timed_out ? "timed out" : "crashed" ) << ", skipped\n\n";
+		skip.insert( current );
+		after = current;
+	}
+
+	Journal( "done\t" + file );
+}
+
+int BatchSupervisor::RunWorker( const char* path, const char* out_path, cell_t after, const std::set<cell_t>& skip,
+	const DecompilerOptions& options )
+{
+#ifdef _WIN32
+	// Crashes and failed asserts should just end the worker, not wait on a dialog
+	SetErrorMode( SEM_FAILCRITICALERRORS | SEM_NOGPFAULTERRORBOX );
+	_set_error_mode( _OUT_TO_STDERR );
+	_set_abort_behavior( 0, _WRITE_ABORT_MSG | _CALL_REPORTFAULT );
+#endif
+
+	SmxFile smx( path );
+	std::ofstream out( out_path, std::ios::app );
+	if( !out )
+		return 1;
+
+	if( smx.code_size() != 0 )
+	{
+		// Functions go by address rather than the order of the tables, which depends on what was
+		// discovered while decompiling earlier functions
+		XrefIndex xrefs( smx );
+		Decompiler decompiler( smx, options );
+		for( size_t i = 0; i < xrefs.num_functions(); i++ )
+		{
+			cell_t start = xrefs.function( i );
+			if( start <= after )
+				continue;
+			if( skip.count( start ) )
+			{
+				out << "// " << xrefs.FunctionName( start ) << ": decompiler crashed, skipped\n\n";
+				continue;
+			}
+
+			std::cout << "begin " << start << ' ' << xrefs.FunctionName( start ) << std::endl;
+
+			SmxFunction* func = smx.FindFunctionAt( start );
+			if( !func )
+			{
+				smx.AddFunction( start );
+				func = smx.FindFunctionAt( start );
+			}
+			out << decompiler.Decompile( *func ).code << '\n';
+			out.flush();
+
+			std::cout << "end " << start << std::endl;
+		}
+	}
+
+	std::cout << "done" << std::endl;
+	return 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "smx-file.h"
+#include "decompiler-options.h"
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <fstream>
+#include <unordered_map>
+
+// Decompiles many files, each in its own worker process, so a function that takes the decompiler
+// down (failed assert, bad input) only loses that function instead of the whole batch. Workers
+// report every function before and after decompiling it. If one dies in between, the function is
+// recorded as failed and a new worker continues after it. The same goes for a worker that stops
+// reporting for longer than the timeout, it is killed. Finished files and failed functions are
+// journaled in the output directory, running the same batch again skips everything journaled
+class BatchSupervisor
+{
+public:
+	// worker_command starts this program, worker_args are passed on to every worker as they are.
+	// A timeout of 0 lets workers take as long as they like
+	BatchSupervisor( std::string worker_command, std::vector<std::string> worker_args, std::string out_dir,
+		unsigned int timeout_ms );
+
+	// Returns false if the output directory or journal couldn't be written
+	bool Run( const std::vector<std::string>& files, unsigned int num_workers );
+
+	size_t num_skipped_files() const { return num_skipped_files_; }
+	size_t num_failed_functions() const { return num_failed_functions_; }
+
+	// Worker side: decompiles the functions of the file starting after `after` (in order of address),
+	// except those in skip, and appends their code to out_path
+	static int RunWorker( const char* path, const char* out_path, cell_t after, const std::set<cell_t>& skip,
+		const DecompilerOptions& options );
+private:
+	void ReadJournal();
+	void Journal( const std::string& line );
+	void ProcessFile( const std::string& file );
+	std::string OutputPath( const std::string& file ) const;
+private:
+	std::string worker_command_;
+	std::vector<std::string> worker_args_;
+	std::string out_dir_;
+	unsigned int timeout_ms_;
+
+	std::mutex mutex_; // Guards everything below
+	std::ofstream journal_;
+	std::set<std::string> done_;
+	std::unordered_map<std::string, std::set<cell_t>> failed_;
+	size_t num_skipped_files_ = 0;
+	size_t num_failed_functions_ = 0;
+};
@@ -0,0 +1,31 @@
+#include "budget.h"
+
+thread_local DecompileBudget* DecompileBudget::current_ = nullptr;
+
+DecompileBudget::DecompileBudget( double max_ms, size_t max_bytes ) :
+	previous_( current_ ),
+	start_( std::chrono::steady_clock::now() ),
+	max_ms_( max_ms ),
+	max_bytes_( max_bytes )
+{
+	current_ = this;
+}
+
+DecompileBudget::~DecompileBudget()
+{
+	current_ = previous_;
+}
+
+double DecompileBudget::elapsed_ms() const
+{
+	return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start_ ).count();
+}
+
+void DecompileBudget::CheckLimits()
+{
+	countdown_ = kChecksPerClockRead;
+	if( max_bytes_ && allocated_ > max_bytes_ )
+		throw BudgetExceeded{ "memory" };
+	if( max_ms_ > 0.0 && elapsed_ms() > max_ms_ )
+		throw BudgetExceeded{ "time" };
+}
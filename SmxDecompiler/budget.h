@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+// Thrown out of whatever was running once a limit of the thread's budget is passed
+struct BudgetExceeded
+{
+	const char* limit; // "time" or "memory"
+};
+
+// Limits on the wall-clock time and IL memory spent decompiling a single function. Creating a
+// budget makes it the active one for the thread until it is destroyed. Long running loops call
+// Check(), which throws BudgetExceeded so pathological functions can be given up on from wherever
+// they got stuck. Without an active budget the checks do nothing
+class DecompileBudget
+{
+public:
+	// 0 for no limit
+	DecompileBudget( double max_ms, size_t max_bytes );
+	~DecompileBudget();
+	DecompileBudget( const DecompileBudget& ) = delete;
+	DecompileBudget& operator=( const DecompileBudget& ) = delete;
+
+	static void Check()
+	{
+		// Reading the clock is the expensive part, so it is only done every so often
+		if( current_ && --current_->countdown_ == 0 )
+			current_->CheckLimits();
+	}
+	static void Allocated( size_t bytes )
+	{
+		if( current_ )
+			current_->allocated_ += bytes;
+	}
+
+	double elapsed_ms() const;
+	size_t allocated() const { return allocated_; }
+private:
+	void CheckLimits();
+private:
+	static constexpr int kChecksPerClockRead = 64;
+	static thread_local DecompileBudget* current_;
+
+	DecompileBudget* previous_;
+	std::chrono::steady_clock::time_point start_;
+	double max_ms_;
+	size_t max_bytes_;
+	size_t allocated_ = 0;
+	int countdown_ = kChecksPerClockRead;
+};
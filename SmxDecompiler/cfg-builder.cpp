@@ -1,6 +1,7 @@
 #include "cfg-builder.h"
 
 #include "smx-disasm.h"
+#include "trace.h"
 #include <algorithm>
 #include <cassert>
 
@@ -9,6 +10,7 @@ CfgBuilder::CfgBuilder( const SmxFile& smx ) : smx_( &smx )
 
 ControlFlowGraph CfgBuilder::Build( const cell_t* entry )
 {
+	TraceSpan span( "CfgBuilder" );
 	MarkLeaders( entry );
 
 	for( const cell_t* leader : leaders_ )
@@ -31,7 +33,7 @@ ControlFlowGraph CfgBuilder::Build( const cell_t* entry )
 			case SMX_OP_JUMP:
 			{
 				cell_t* target = smx_->code( last_instr[1] );
-				curr_block->AddTarget( cfg_.FindBlockAt( target ) );
+				cfg_.AddEdge( *curr_block, *cfg_.FindBlockAt( target ) );
 				break;
 			}
 			case SMX_OP_JEQ:
@@ -44,8 +46,8 @@ ControlFlowGraph CfgBuilder::Build( const cell_t* entry )
 			case SMX_OP_JSLEQ:
 			{
 				cell_t* target = smx_->code( last_instr[1] );
-				curr_block->AddTarget( cfg_.FindBlockAt( target ) );
-				curr_block->AddTarget( cfg_.FindBlockAt( next_leader ) );
+				cfg_.AddEdge( *curr_block, *cfg_.FindBlockAt( target ) );
+				cfg_.AddEdge( *curr_block, *cfg_.FindBlockAt( next_leader ) );
 				break;
 			}
 			case SMX_OP_SWITCH:
@@ -53,11 +55,11 @@ ControlFlowGraph CfgBuilder::Build( const cell_t* entry )
 				cell_t* casetbl = smx_->code( last_instr[1] );
 				cell_t ncases = casetbl[1];
 				cell_t* def = smx_->code( casetbl[2] );
-				curr_block->AddTarget( cfg_.FindBlockAt( def ) );
+				cfg_.AddEdge( *curr_block, *cfg_.FindBlockAt( def ) );
 				for( cell_t i = 0; i < ncases; i++ )
 				{
 					cell_t* target = smx_->code( casetbl[3 + i * 2 + 1] );
-					curr_block->AddTarget( cfg_.FindBlockAt( target ) );
+					cfg_.AddEdge( *curr_block, *cfg_.FindBlockAt( target ) );
 				}
 				break;
 			}
@@ -72,7 +74,7 @@ ControlFlowGraph CfgBuilder::Build( const cell_t* entry )
 				// Fall-through to next block
 				if( BasicBlock* bb = cfg_.FindBlockAt( next_leader ) )
 				{
-					curr_block->AddTarget( bb );
+					cfg_.AddEdge( *curr_block, *bb );
 				}
 				break;
 			}
@@ -84,6 +86,20 @@ ControlFlowGraph CfgBuilder::Build( const cell_t* entry )
 	return std::move( cfg_ );
 }
 
+CfgBuilder::Size CfgBuilder::Measure( const cell_t* entry )
+{
+	MarkLeaders( entry );
+
+	Size size = { 0, leaders_.size(), 0 };
+	for( const cell_t* instr = entry; instr < code_end_; instr = NextInstruction( instr ) )
+	{
+		size.instructions++;
+		if( instr[0] == SMX_OP_CASETBL )
+			size.cases += instr[1];
+	}
+	return size;
+}
+
 const cell_t* CfgBuilder::NextInstruction( const cell_t* instr ) const
 {
 	auto op = (SmxOpcode)instr[0];
@@ -8,7 +8,16 @@ class CfgBuilder
 public:
 	CfgBuilder( const SmxFile& smx );
 
+	// What a function's graph will be built from, found without building it
+	struct Size
+	{
+		size_t instructions;
+		size_t leaders;
+		size_t cases; // Entries of all case tables
+	};
+
 	ControlFlowGraph Build( const cell_t* entry );
+	Size Measure( const cell_t* entry );
 private:
 	const cell_t* NextInstruction( const cell_t* instr ) const;
 	void MarkLeaders( const cell_t* entry );
@@ -4,6 +4,20 @@
 #include <algorithm>
 #include <cassert>
 
+void BlockEdges::Clear()
+{
+	in_start_.assign( 1, 0 );
+	out_start_.assign( 1, 0 );
+	in_.clear();
+	out_.clear();
+}
+
+void BlockEdges::EndBlock()
+{
+	in_start_.push_back( (uint32_t)in_.size() );
+	out_start_.push_back( (uint32_t)out_.size() );
+}
+
 BasicBlock::BasicBlock( const ControlFlowGraph& cfg, const cell_t* start )
 	:
 	start_( start ),
@@ -11,12 +25,6 @@ BasicBlock::BasicBlock( const ControlFlowGraph& cfg, const cell_t* start )
 	cfg_( &cfg )
 {}
 
-void BasicBlock::AddTarget( BasicBlock* bb )
-{
-	bb->in_edges_.push_back( this );
-	out_edges_.push_back( bb );
-}
-
 void BasicBlock::SetEnd( const cell_t* addr )
 {
 	end_ = addr;
@@ -32,11 +40,6 @@ bool BasicBlock::Contains( const cell_t* addr ) const
 	return addr >= start_ && addr < end_;
 }
 
-bool BasicBlock::IsBackEdge( size_t index ) const
-{
-	return out_edges_[index]->id_ < id_;
-}
-
 bool BasicBlock::IsVisited() const
 {
 	return epoch_ == cfg_->epoch();
@@ -65,6 +68,11 @@ BasicBlock* ControlFlowGraph::FindBlockAt( const cell_t* addr )
 	return nullptr;
 }
 
+void ControlFlowGraph::AddEdge( const BasicBlock& from, const BasicBlock& to )
+{
+	new_edges_.emplace_back( (uint32_t)(&from - blocks_.data()), (uint32_t)(&to - blocks_.data()) );
+}
+
 void ControlFlowGraph::Remove( size_t block_index )
 {
 	blocks_.erase( blocks_.begin() + block_index );
@@ -72,37 +80,71 @@ void ControlFlowGraph::Remove( size_t block_index )
 
 void ControlFlowGraph::ComputeOrdering()
 {
+	// Same edges indexed by position in blocks_, since ids aren't known until the blocks are ordered.
+	// Sorts are stable so that edges stay in the order they were added
+	std::vector<std::pair<uint32_t, uint32_t>> in_edges = new_edges_;
+	std::stable_sort( in_edges.begin(), in_edges.end(), []( const auto& a, const auto& b ) {
+		return a.second < b.second;
+	} );
+	std::stable_sort( new_edges_.begin(), new_edges_.end(), []( const auto& a, const auto& b ) {
+		return a.first < b.first;
+	} );
+
+	BlockEdges by_index;
+	size_t in = 0, out = 0;
+	for( size_t i = 0; i < blocks_.size(); i++ )
+	{
+		for( ; in < in_edges.size() && in_edges[in].second == i; in++ )
+			by_index.AddIn( in_edges[in].first );
+		for( ; out < new_edges_.size() && new_edges_[out].first == i; out++ )
+			by_index.AddOut( new_edges_[out].second );
+		by_index.EndBlock();
+	}
+	new_edges_.clear();
+
 	// Prune blocks with no input edges (other than the entry node)
 	// This happens with casetbl instruction, which is never meant to actually be executed
 	ordered_blocks_.reserve( blocks_.size() );
-	for( BasicBlock& bb : blocks_ )
+	for( size_t i = 0; i < blocks_.size(); i++ )
 	{
-		if( &bb != &EntryBlock() && bb.num_in_edges() == 0 )
+		if( &blocks_[i] != &EntryBlock() && by_index.num_in_edges( i ) == 0 )
 		{
 			continue;
 		}
 		
-		ordered_blocks_.push_back( &bb );
+		ordered_blocks_.push_back( &blocks_[i] );
 	}
 
 	NewEpoch();
-	VisitPostOrderAndSetId( EntryBlock(), 1 );
+	VisitPostOrderAndSetId( by_index, 0, 1 );
 	std::sort( ordered_blocks_.begin(), ordered_blocks_.end(), []( const BasicBlock* a, const BasicBlock* b ) {
 		return a->id() < b->id();
 	} );
+
+	edges_.Clear();
+	for( BasicBlock* bb : ordered_blocks_ )
+	{
+		size_t index = bb - blocks_.data();
+		for( size_t i = 0; i < by_index.num_in_edges( index ); i++ )
+			edges_.AddIn( blocks_[by_index.in_edge( index, i )].id() );
+		for( size_t i = 0; i < by_index.num_out_edges( index ); i++ )
+			edges_.AddOut( blocks_[by_index.out_edge( index, i )].id() );
+		edges_.EndBlock();
+	}
 }
 
-size_t ControlFlowGraph::VisitPostOrderAndSetId( BasicBlock& bb, size_t po_number )
+size_t ControlFlowGraph::VisitPostOrderAndSetId( const BlockEdges& edges, size_t index, size_t po_number )
 {
+	BasicBlock& bb = blocks_[index];
 	bb.SetVisited();
-	for( size_t out = 0; out < bb.num_out_edges(); out++ )
+	for( size_t out = 0; out < edges.num_out_edges( index ); out++ )
 	{
-		BasicBlock& successor = *bb.out_edge( out );
-		if( successor.IsVisited() )
+		size_t successor = edges.out_edge( index, out );
+		if( blocks_[successor].IsVisited() )
 		{
 			continue;
 		}
-		po_number = VisitPostOrderAndSetId( successor, po_number );
+		po_number = VisitPostOrderAndSetId( edges, successor, po_number );
 	}
 	
 	bb.id_ = num_blocks() - po_number; // Set ID to RPO index
@@ -2,14 +2,38 @@
 
 #include "smx-file.h"
 #include <vector>
+#include <utility>
+#include <cstdint>
 
 class ControlFlowGraph;
 
+// Edges of a graph in compressed sparse row form, indexed by block id. This is a snapshot,
+// so it has to be rebuilt whenever blocks or edges of the graph change
+class BlockEdges
+{
+public:
+	void Clear();
+	// Blocks have to be added in id order, with AddIn/AddOut for each of its edges then EndBlock
+	void AddIn( size_t id ) { in_.push_back( (uint32_t)id ); }
+	void AddOut( size_t id ) { out_.push_back( (uint32_t)id ); }
+	void EndBlock();
+
+	size_t num_blocks() const { return in_start_.size() - 1; }
+	size_t num_in_edges( size_t block ) const { return in_start_[block + 1] - in_start_[block]; }
+	size_t in_edge( size_t block, size_t index ) const { return in_[in_start_[block] + index]; }
+	size_t num_out_edges( size_t block ) const { return out_start_[block + 1] - out_start_[block]; }
+	size_t out_edge( size_t block, size_t index ) const { return out_[out_start_[block] + index]; }
+private:
+	std::vector<uint32_t> in_start_ = { 0 };
+	std::vector<uint32_t> out_start_ = { 0 };
+	std::vector<uint32_t> in_;
+	std::vector<uint32_t> out_;
+};
+
 class BasicBlock
 {
 public:
 	BasicBlock( const ControlFlowGraph& cfg, const cell_t* start );
-	void AddTarget( BasicBlock* bb );
 	void SetEnd( const cell_t* addr );
 
 	bool Contains( const cell_t* addr ) const;
@@ -18,12 +42,6 @@ public:
 	size_t id() const { return id_; }
 	const cell_t* start() const { return start_; }
 	const cell_t* end() const { return end_; }
-	size_t num_in_edges() const { return in_edges_.size(); }
-	BasicBlock* in_edge( size_t index ) const { return in_edges_[index]; }
-	size_t num_out_edges() const { return out_edges_.size(); }
-	BasicBlock* out_edge( size_t index ) const { return out_edges_[index]; }
-
-	bool IsBackEdge( size_t index ) const;
 private:
 	bool IsVisited() const;
 	void SetVisited();
@@ -35,8 +53,6 @@ private:
 	int epoch_ = 0;
 	const cell_t* start_;
 	const cell_t* end_;
-	std::vector<BasicBlock*> in_edges_;
-	std::vector<BasicBlock*> out_edges_;
 };
 
 class ControlFlowGraph
@@ -44,6 +60,8 @@ class ControlFlowGraph
 public:
 	BasicBlock* NewBlock( const cell_t* start );
 	BasicBlock* FindBlockAt( const cell_t* addr );
+	// Edges are only collected here until ComputeOrdering turns them into edges()
+	void AddEdge( const BasicBlock& from, const BasicBlock& to );
 	BasicBlock& EntryBlock() { return blocks_[0]; }
 
 	void SetNumArgs( int nargs ) { nargs_ = nargs; }
@@ -53,11 +71,13 @@ public:
 
 	size_t num_blocks() const { return ordered_blocks_.size(); }
 	BasicBlock& block( size_t index ) const { return *ordered_blocks_[index]; }
+	// Valid from ComputeOrdering on
+	const BlockEdges& edges() const { return edges_; }
 	void Remove( size_t block_index );
 
 	void ComputeOrdering();
 private:
-	size_t VisitPostOrderAndSetId( BasicBlock& bb, size_t po_number );
+	size_t VisitPostOrderAndSetId( const BlockEdges& edges, size_t index, size_t po_number );
 
 	void NewEpoch() { epoch_++; }
 private:
@@ -66,5 +86,8 @@ private:
 	// Blocks ordered in reverse post-order
 	// In separate container so that pointers to blocks are never invalidated
 	std::vector<BasicBlock*> ordered_blocks_;
+	// Indices into blocks_
+	std::vector<std::pair<uint32_t, uint32_t>> new_edges_;
+	BlockEdges edges_;
 	int epoch_ = 0;
 };
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "code-fixer.h"
 
 #include "il.h"
+#include "trace.h"
+#include <set>
+#include <functional>
 
 // Multidim arrays are accessed a bit oddly
 // The compiler will generate "indirection vectors" for the first dimension
@@ -12,12 +15,12 @@
 // After:
 //  `arr[x][y] = z`
 //
-class FixMultidimArrays : public RecursiveILVisitor
+class FixMultidimArrays : public StaticRecursiveILVisitor<FixMultidimArrays>
 {
 public:
-	virtual void VisitArrayElementVar( ILArrayElementVar* node ) override
+	void VisitArrayElementVar( ILArrayElementVar* node )
 	{
-		RecursiveILVisitor::VisitArrayElementVar( node );
+		StaticRecursiveILVisitor::VisitArrayElementVar( node );
 
 		ILNode* base;
 		ILNode* index;
@@ -113,12 +116,12 @@ private:
 // After:
 //  `g_var[i] = 0`
 // 
-class FixConstGlobals : public RecursiveILVisitor
+class FixConstGlobals : public StaticRecursiveILVisitor<FixConstGlobals>
 {
 public:
-	virtual void VisitArrayElementVar( ILArrayElementVar* node ) override
+	void VisitArrayElementVar( ILArrayElementVar* node )
 	{
-		RecursiveILVisitor::VisitArrayElementVar( node );
+		StaticRecursiveILVisitor::VisitArrayElementVar( node );
 
 		if( auto* constant = dynamic_cast<ILConst*>(node->base()) )
 		{
@@ -141,12 +144,12 @@ public:
 //  `x = arr[0]`
 //  `PrintToServer("%s", arr[i])`
 //
-class FixArrays : public RecursiveILVisitor
+class FixArrays : public StaticRecursiveILVisitor<FixArrays>
 {
 public:
-	virtual void VisitLoad( ILLoad* node ) override
+	void VisitLoad( ILLoad* node )
 	{
-		RecursiveILVisitor::VisitLoad( node );
+		StaticRecursiveILVisitor::VisitLoad( node );
 
 		const SmxVariableType* type = node->var()->type();
 		
@@ -180,9 +183,9 @@ public:
 
 		node->ReplaceParam( node->var(), new_var );
 	}
-	virtual void VisitStore( ILStore* node ) override
+	void VisitStore( ILStore* node )
 	{
-		RecursiveILVisitor::VisitStore( node );
+		StaticRecursiveILVisitor::VisitStore( node );
 
 		const SmxVariableType* type = node->var()->type();
 
@@ -209,9 +212,9 @@ public:
 
 		node->ReplaceParam( node->var(), new_var );
 	}
-	virtual void VisitBinary( ILBinary* node ) override
+	void VisitBinary( ILBinary* node )
 	{
-		RecursiveILVisitor::VisitBinary( node );
+		StaticRecursiveILVisitor::VisitBinary( node );
 
 		if( node->op() == ILBinary::ADD )
 		{
@@ -240,7 +243,7 @@ public:
 			node->ReplaceUsesWith( new ILArrayElementVar( base, index ) );
 		}
 	}
-	virtual void VisitArrayElementVar( ILArrayElementVar* node ) override
+	void VisitArrayElementVar( ILArrayElementVar* node )
 	{
 		const SmxVariableType* base_type = node->base()->type();
 		const SmxVariableType* index_type = node->index()->type();
@@ -253,7 +256,7 @@ public:
 		auto* swapped = new ILArrayElementVar( node->index(), node->base() );
 		node->ReplaceUsesWith( swapped );
 
-		RecursiveILVisitor::VisitArrayElementVar( swapped );
+		StaticRecursiveILVisitor::VisitArrayElementVar( swapped );
 	}
 private:
 	bool IsArrayOrEnumStructType( const SmxVariableType* type )
@@ -274,15 +277,15 @@ private:
 // After:
 //  `c = a + b`
 //
-class ReplaceFloatNatives : public RecursiveILVisitor
+class ReplaceFloatNatives : public StaticRecursiveILVisitor<ReplaceFloatNatives>
 {
 public:
 	ReplaceFloatNatives( SmxFile& smx ) : smx_( &smx ) {}
 
-	virtual void VisitNative( ILNative* node ) override
+	void VisitNative( ILNative* node )
 	{
 		// Handle the args of this call, they can contain native calls that we want to replace too
-		RecursiveILVisitor::VisitNative( node );
+		StaticRecursiveILVisitor::VisitNative( node );
 
 		SmxNative* native = smx_->FindNativeByIndex( node->native_index() );
 		assert( native );
@@ -343,7 +346,7 @@ private:
 // After:
 //  `return`
 //
-class RemoveVoidRets : public ILVisitor
+class RemoveVoidRets : public StaticILVisitor<RemoveVoidRets>
 {
 public:
 	void VisitReturn( ILReturn* node )
@@ -362,12 +365,12 @@ public:
 //  `if (x == 2) {}`
 //  `if (!(x > 0)) {}`
 //
-class UseBoolOps : public RecursiveILVisitor
+class UseBoolOps : public StaticRecursiveILVisitor<UseBoolOps>
 {
 public:
 	void VisitBinary( ILBinary* node )
 	{
-		RecursiveILVisitor::VisitBinary( node );
+		StaticRecursiveILVisitor::VisitBinary( node );
 
 		if( node->op() != ILBinary::EQ && node->op() != ILBinary::NEQ )
 			return;
@@ -395,54 +398,83 @@ public:
 void CodeFixer::ApplyFixes( ILControlFlowGraph& cfg ) const
 {
 	FixArrays arrays;
-	VisitAllNodes( cfg, arrays );
+	VisitAllNodes( cfg, arrays, "FixArrays" );
 	
 	FixMultidimArrays multidim_arrays;
-	VisitAllNodes( cfg, multidim_arrays );
+	VisitAllNodes( cfg, multidim_arrays, "FixMultidimArrays" );
 
 	FixConstGlobals fix_const_globals;
-	VisitAllNodes( cfg, fix_const_globals );
+	VisitAllNodes( cfg, fix_const_globals, "FixConstGlobals" );
 
 	ReplaceFloatNatives replace_float_natives( *smx_ );
-	VisitAllNodes( cfg, replace_float_natives );
+	VisitAllNodes( cfg, replace_float_natives, "ReplaceFloatNatives" );
 
 	SmxFunction* func = smx_->FindFunctionAt( cfg.Entry().pc() );
-	if( func->signature.ret && func->signature.ret->tag == SmxVariableType::VOID )
+	if( func->signature().ret && func->signature().ret->tag == SmxVariableType::VOID )
 	{
 		RemoveVoidRets remove_void_rets;
-		VisitAllNodes( cfg, remove_void_rets );
+		VisitAllNodes( cfg, remove_void_rets, "RemoveVoidRets" );
 	}
 
 	UseBoolOps use_bool_ops;
-	VisitAllNodes( cfg, use_bool_ops );
+	VisitAllNodes( cfg, use_bool_ops, "UseBoolOps" );
 
-	for( int i = (int)cfg.num_blocks() - 1; i >= 0; i-- )
 	{
-		CleanStores( cfg.block( i ) );
-		CleanIncAndDec( cfg.block( i ) );
-		RemoveTmpLocalVars( cfg.block( i ) );
+		TraceSpan span( "CleanStores" );
+		for( int i = (int)cfg.num_blocks() - 1; i >= 0; i-- )
+		{
+			DecompileBudget::Check();
+			CleanStores( cfg.block( i ) );
+			CleanIncAndDec( cfg.block( i ) );
+			RemoveTmpLocalVars( cfg.block( i ) );
+		}
 	}
 
-	for( int i = (int)cfg.num_blocks() - 1; i >= 0; i-- )
+	// Only two-way branches can start a short circuit, later ones are handled first. Removing a
+	// condition moves its code and in edges into the block using the result, so that block and
+	// its new predecessors are the only ones that need another look
 	{
-		FixShortCircuitConditions( cfg, cfg.block( i ) );
+		TraceSpan span( "FixShortCircuitConditions" );
+		std::set<size_t, std::greater<size_t>> worklist;
+		for( size_t i = 0; i < cfg.num_blocks(); i++ )
+		{
+			if( cfg.block( i ).num_out_edges() == 2 )
+				worklist.insert( i );
+		}
+		while( !worklist.empty() )
+		{
+			DecompileBudget::Check();
+			ILBlock& bb = cfg.block( *worklist.begin() );
+			worklist.erase( worklist.begin() );
+
+			if( ILBlock* real_cond_block = FixShortCircuitConditions( cfg, bb ) )
+			{
+				worklist.insert( real_cond_block->id() );
+				for( size_t i = 0; i < real_cond_block->num_in_edges(); i++ )
+					worklist.insert( real_cond_block->in_edge( i ).id() );
+			}
+		}
 	}
 	cfg.ComputeDominance();
 
+	TraceSpan span( "FixArrayAndESDecl" );
 	for( int i = (int)cfg.num_blocks() - 1; i >= 0; i-- )
 	{
 		FixArrayAndESDecl( cfg.block( i ) );
 	}
 }
 
-void CodeFixer::VisitAllNodes( ILControlFlowGraph& cfg, ILVisitor& visitor ) const
+template <typename Visitor>
+void CodeFixer::VisitAllNodes( ILControlFlowGraph& cfg, Visitor& visitor, const char* pass ) const
 {
+	TraceSpan span( pass );
 	for( size_t i = 0; i < cfg.num_blocks(); i++ )
 	{
+		DecompileBudget::Check();
 		ILBlock& bb = cfg.block( i );
-		for( size_t node = 0; node < bb.num_nodes(); node++ )
+		for( ILNode* node = bb.First(); node; node = node->next() )
 		{
-			bb.node( node )->Accept( &visitor );
+			visitor.Visit( node );
 		}
 	}
 }
@@ -461,18 +493,19 @@ void CodeFixer::CleanStores( ILBlock& bb ) const
 	// ```
 	// float x = a + b;
 	//
-	for( int i = (int)bb.num_nodes() - 1; i >= 1; i-- )
+	for( ILNode* node = bb.Last(), *prev; node; node = prev )
 	{
-		if( auto* store = dynamic_cast<ILStore*>(bb.node( i )) )
+		prev = node->prev();
+		if( auto* store = dynamic_cast<ILStore*>(node) )
 		{
 			if( auto* store_var = dynamic_cast<ILLocalVar*>(store->var()) )
 			{
-				if( auto* decl_var = dynamic_cast<ILLocalVar*>(bb.node( i - 1 )) )
+				if( auto* decl_var = dynamic_cast<ILLocalVar*>(prev) )
 				{
 					if( store_var == decl_var && decl_var->value() == nullptr )
 					{
 						decl_var->SetValue( store->val() );
-						bb.Remove( i );
+						bb.Remove( store );
 					}
 				}
 			}
@@ -491,15 +524,16 @@ void CodeFixer::CleanIncAndDec( ILBlock& bb ) const
 	// When we actually want:
 	// `++i`
 	//
-	for( int i = (int)bb.num_nodes() - 1; i >= 0; i-- )
+	for( ILNode* node = bb.Last(), *prev; node; node = prev )
 	{
-		if( auto* store = dynamic_cast<ILStore*>(bb.node( i )) )
+		prev = node->prev();
+		if( auto* store = dynamic_cast<ILStore*>(node) )
 		{
 			if( auto* unary = dynamic_cast<ILUnary*>(store->val()) )
 			{
 				if( unary->op() == ILUnary::INC || unary->op() == ILUnary::DEC )
 				{
-					bb.Replace( i, unary );
+					bb.Replace( store, unary );
 				}
 			}
 		}
@@ -521,9 +555,10 @@ void CodeFixer::RemoveTmpLocalVars( ILBlock& bb ) const
 	// this case, only variables that don't have any debug info associated with them are
 	// removed.
 	//
-	for( int i = (int)bb.num_nodes() - 1; i >= 0; i-- )
+	for( ILNode* node = bb.Last(), *prev; node; node = prev )
 	{
-		if( auto* local_var = dynamic_cast<ILLocalVar*>(bb.node( i )) )
+		prev = node->prev();
+		if( auto* local_var = dynamic_cast<ILLocalVar*>(node) )
 		{
 			if( local_var->smx_var() )
 				continue;
@@ -532,9 +567,9 @@ void CodeFixer::RemoveTmpLocalVars( ILBlock& bb ) const
 				continue;
 
 			local_var->ReplaceUsesWith( local_var->value() );
-			bb.Remove( i );
+			bb.Remove( local_var );
 		}
-		else if( auto* tmp_var = dynamic_cast<ILTempVar*>(bb.node( i )) )
+		else if( auto* tmp_var = dynamic_cast<ILTempVar*>(node) )
 		{
 			if( tmp_var->smx_var() )
 				continue;
@@ -543,7 +578,7 @@ void CodeFixer::RemoveTmpLocalVars( ILBlock& bb ) const
 				continue;
 
 			tmp_var->ReplaceUsesWith( tmp_var->value() );
-			bb.Remove( i );
+			bb.Remove( tmp_var );
 		}
 	}
 }
@@ -568,9 +603,9 @@ void CodeFixer::FixArrayAndESDecl( ILBlock& bb ) const
 	// 	y[0] = 10;
 	// 	```
 	//
-	for( size_t i = 0; i < bb.num_nodes(); i++ )
+	for( ILNode* node = bb.First(); node; node = node->next() )
 	{
-		if( auto* local_var = dynamic_cast<ILLocalVar*>( bb.node( i ) ) )
+		if( auto* local_var = dynamic_cast<ILLocalVar*>( node ) )
 		{
 			if( !local_var->value() )
 				continue;
@@ -596,12 +631,12 @@ void CodeFixer::FixArrayAndESDecl( ILBlock& bb ) const
 
 			ILNode* value = local_var->value();
 			local_var->ReplaceParam( value, nullptr );
-			bb.Insert( i + 1, new ILStore( new_var, value ) );
+			bb.InsertAfter( local_var, new ILStore( new_var, value ) );
 		}
 	}
 }
 
-void CodeFixer::FixShortCircuitConditions( ILControlFlowGraph& cfg, ILBlock& bb ) const
+ILBlock* CodeFixer::FixShortCircuitConditions( ILControlFlowGraph& cfg, ILBlock& bb ) const
 {
 	// Short circuit conditions (&&/||) generate code that assigns to some tmp var, then
 	// checks the tmp var to actually run the user code. This pass removes the tmp var
@@ -630,9 +665,12 @@ void CodeFixer::FixShortCircuitConditions( ILControlFlowGraph& cfg, ILBlock& bb
 	//  }
 	//  ```
 	//
+	if( bb.IsRemoved() )
+		return nullptr;
+
 	auto* node = dynamic_cast<ILJumpCond*>(bb.Last());
 	if( !node )
-		return;
+		return nullptr;
 
 	ILBlock* then_branch = node->true_branch();
 	ILBlock* else_branch = node->false_branch();
@@ -640,28 +678,28 @@ void CodeFixer::FixShortCircuitConditions( ILControlFlowGraph& cfg, ILBlock& bb
 		else_branch->num_nodes() != 2 ||
 		then_branch->num_in_edges() != 1 ||
 		else_branch->num_in_edges() != 1 )
-		return;
+		return nullptr;
 
 	auto* jmp = dynamic_cast<ILJump*>(else_branch->Last());
 	if( !jmp )
-		return;
+		return nullptr;
 
-	auto* then_store = dynamic_cast<ILStore*>(then_branch->node( 0 ));
-	auto* else_store = dynamic_cast<ILStore*>(else_branch->node( 0 ));
+	auto* then_store = dynamic_cast<ILStore*>(then_branch->First());
+	auto* else_store = dynamic_cast<ILStore*>(else_branch->First());
 	if( !then_store || !else_store || then_store->var() != else_store->var() )
-		return;
+		return nullptr;
 
 	auto* tmp = then_store->var();
 
 	auto* then_const = dynamic_cast<ILConst*>(then_store->val());
 	auto* else_const = dynamic_cast<ILConst*>(else_store->val());
 	if( !then_const || !else_const )
-		return;
+		return nullptr;
 
 	cell_t then_val = then_const->value();
 	cell_t else_val = else_const->value();
 	if( then_val != !else_val )
-		return;
+		return nullptr;
 
 	if( then_val == 0 )
 	{
@@ -681,9 +719,11 @@ void CodeFixer::FixShortCircuitConditions( ILControlFlowGraph& cfg, ILBlock& bb
 		real_cond_block->AddInEdge( bb.in_edge( i ) );
 	}
 
-	for( int i = (int)bb.num_nodes() - 2; i >= 0; i-- )
+	for( ILNode* move = node->prev(), *prev; move; move = prev )
 	{
-		real_cond_block->AddToStart( bb.node( i ) );
+		prev = move->prev();
+		bb.Remove( move );
+		real_cond_block->AddToStart( move );
 	}
 
 	ILBlock* remove[] = { &bb, then_branch, else_branch };
@@ -691,20 +731,24 @@ void CodeFixer::FixShortCircuitConditions( ILControlFlowGraph& cfg, ILBlock& bb
 
 	// Remove unnecessary references to tmp
 	real_cond_block->Remove( tmp );
-	for( int i = (int)tmp->num_uses() - 1; i >= 0; i-- )
+	for( ILUse* use = tmp->first_use(); use; )
 	{
-		auto* store = dynamic_cast<ILStore*>(tmp->use( i ));
+		ILUse* next = use->next();
+		auto* store = dynamic_cast<ILStore*>(use->user());
 		if( store && store->var() == tmp )
 		{
-			tmp->RemoveUse( i );
+			tmp->RemoveUse( use );
 			store->ReplaceUsesWith( node->condition() );
 		}
-		else if( auto* load = dynamic_cast<ILLoad*>( tmp->use( i ) ) )
+		else if( auto* load = dynamic_cast<ILLoad*>( use->user() ) )
 		{
-			tmp->RemoveUse( i );
+			tmp->RemoveUse( use );
 			load->ReplaceUsesWith( node->condition() );
 		}
+		use = next;
 	}
 
 	tmp->ReplaceUsesWith( node->condition() );
+
+	return real_cond_block;
 }
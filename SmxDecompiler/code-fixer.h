@@ -14,9 +14,12 @@ private:
 	void CleanIncAndDec( ILBlock& bb ) const;
 	void RemoveTmpLocalVars( ILBlock& bb ) const;
 	void FixArrayAndESDecl( ILBlock& bb ) const;
-	void FixShortCircuitConditions( ILControlFlowGraph& cfg, ILBlock& bb ) const;
+	// Returns the block now holding the condition if bb was the start of a short circuit
+	ILBlock* FixShortCircuitConditions( ILControlFlowGraph& cfg, ILBlock& bb ) const;
 
-	void VisitAllNodes( ILControlFlowGraph& cfg, class ILVisitor& visitor ) const;
+	// Runs the visitor over every node, pass names the pass in traces
+	template <typename Visitor>
+	void VisitAllNodes( ILControlFlowGraph& cfg, Visitor& visitor, const char* pass ) const;
 private:
 	SmxFile* smx_;
 };
\ No newline at end of file
@@ -1,5 +1,54 @@
 #include "code-writer.h"
 
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define CODE_WRITER_USE_SSE2
+#endif
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+// Index of the first character that needs escaping in a string literal, or length if there is none.
+// Control characters can be left out of the search if the string is known not to have any
+static size_t FindCharToEscape( const char* str, size_t length, char quote, bool check_control )
+{
+	size_t i = 0;
+#if defined( CODE_WRITER_USE_SSE2 )
+	const __m128i backslash = _mm_set1_epi8( '\\' );
+	const __m128i quotes = _mm_set1_epi8( quote );
+	const __m128i max_control = _mm_set1_epi8( 0x1f );
+	for( ; i + 16 <= length; i += 16 )
+	{
+		__m128i bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>( str + i ) );
+		__m128i special = _mm_or_si128( _mm_cmpeq_epi8( bytes, backslash ), _mm_cmpeq_epi8( bytes, quotes ) );
+		// Unsigned x <= 0x1f is the same as min( x, 0x1f ) == x
+		if( check_control )
+			special = _mm_or_si128( special, _mm_cmpeq_epi8( _mm_min_epu8( bytes, max_control ), bytes ) );
+
+		unsigned int mask = (unsigned int)_mm_movemask_epi8( special );
+		if( mask != 0 )
+		{
+#if defined( _MSC_VER )
+			unsigned long index;
+			_BitScanForward( &index, mask );
+			return i + index;
+#else
+			return i + __builtin_ctz( mask );
+#endif
+		}
+	}
+#endif
+
+	for( ; i < length; i++ )
+	{
+		unsigned char c = (unsigned char)str[i];
+		if( c == '\\' || c == (unsigned char)quote || c < 0x20 )
+			return i;
+	}
+	return length;
+}
+
 CodeWriter::CodeWriter( SmxFile& smx, SmxFunction* func, StringDetectType string_detect ) :
 	smx_( &smx ),
 	func_( func ),
@@ -8,15 +57,9 @@ CodeWriter::CodeWriter( SmxFile& smx, SmxFunction* func, StringDetectType string
 
 std::string CodeWriter::Build( Statement* stmt )
 {
-	std::string name;
-	if( func_->name )
-		name = func_->name;
-	else
-		name = "func_" + std::to_string( func_->pcode_start );
-
 	if( func_->is_public )
 		code_ << "public ";
-	code_ << BuildFuncDecl( name, &func_->signature ) << '\n';
+	code_ << BuildFuncDecl( FunctionName(), &func_->signature() ) << '\n';
 	code_ << "{\n";
 	Indent();
 	Visit( stmt );
@@ -25,6 +68,13 @@ std::string CodeWriter::Build( Statement* stmt )
 	return code_.str();
 }
 
+std::string CodeWriter::FunctionName() const
+{
+	if( func_->name )
+		return func_->name;
+	return "func_" + std::to_string( func_->pcode_start );
+}
+
 void CodeWriter::VisitBasicStatement( BasicStatement * stmt )
 {
 	for( size_t node = 0; node < stmt->num_nodes(); node++ )
@@ -439,7 +489,7 @@ void CodeWriter::Visit( Statement* stmt )
 std::string CodeWriter::Build( ILNode* node )
 {
 	level_++;
-	node->Accept( this );
+	StaticILVisitor::Visit( node );
 	level_--;
 	return "";
 }
@@ -567,7 +617,7 @@ std::string CodeWriter::BuildTypedValue( cell_t* val, const SmxVariableType* typ
 	{
 		if( string_detect_ != StringDetectType::NONE && IsPossibleString( *val ) )
 		{
-			std::string literal = BuildStringLiteral( (char*)smx_->data( *val ) );
+			std::string literal = BuildStringLiteral( *val );
 			if( string_detect_ == StringDetectType::AGGRESSIVE )
 			{
 				return literal;
@@ -618,7 +668,7 @@ std::string CodeWriter::BuildTypedValue( cell_t* val, const SmxVariableType* typ
 				return std::string("'") + BuildEscapedChar(*val, '\'') + "'";
 			}
 
-			return BuildStringLiteral( (char*)smx_->data(*val) );
+			return BuildStringLiteral( *val );
 		}
 
 		case SmxVariableType::ENUM:
@@ -669,13 +719,24 @@ void CodeWriter::Dedent()
 	indent_--;
 }
 
-std::string CodeWriter::BuildStringLiteral( const char* str )
+std::string CodeWriter::BuildStringLiteral( cell_t addr )
 {
+	const char* str = (const char*)smx_->data( addr );
+	size_t length = smx_->StringLength( addr );
+
+	bool printable = smx_->IsPrintableString( addr );
+
+	// Runs of characters that don't need escaping are copied as they are
 	std::string lit;
+	lit.reserve( length + 2 );
 	lit += '"';
-	for( const char* c = str; *c; c++ )
+	for( size_t i = 0; i < length; i++ )
 	{
-		lit += BuildEscapedChar( *c, '"' );
+		size_t run = FindCharToEscape( str + i, length - i, '"', !printable );
+		lit.append( str + i, run );
+		i += run;
+		if( i < length )
+			lit += BuildEscapedChar( str[i], '"' );
 	}
 	lit += '"';
 
@@ -722,12 +783,10 @@ std::string CodeWriter::BuildEscapedChar( char c, char quote )
 
 bool CodeWriter::IsPossibleString( cell_t val ) const
 {
-	if( val < 0x8e4 || val >= smx_->data_size() )
+	if( val < 0x8e4 )
 		return false;
 
-	// Make sure it points to the start of a string
-	char* data = reinterpret_cast<char*>( smx_->data( (size_t)val ) );
-	return data[0] != 0 && data[-1] == 0;
+	return smx_->IsStringStart( val );
 }
 
 std::string CodeWriter::Comment( const std::string& contents ) const
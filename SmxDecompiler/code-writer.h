@@ -4,12 +4,14 @@
 #include "structurizer.h"
 #include "decompiler-options.h"
 
-class CodeWriter : public StatementVisitor, public ILVisitor
+class CodeWriter : public StatementVisitor, public StaticILVisitor<CodeWriter>
 {
 public:
 	CodeWriter( SmxFile& smx, SmxFunction* func, StringDetectType string_detect = StringDetectType::NONE );
 
 	std::string Build( Statement* stmt );
+	// Name used for the function, unnamed functions are named after their address
+	std::string FunctionName() const;
 	std::string BuildVarDecl( const std::string& var_name, const SmxVariableType* type );
 	std::string BuildFuncDecl( const std::string& func_name, const SmxFunctionSignature* sig );
 	std::string BuildTypedValue( cell_t* val, const SmxVariableType* type );
@@ -24,24 +26,24 @@ public:
 	virtual void VisitBreakStatement( BreakStatement* stmt ) override;
 	virtual void VisitGotoStatement( GotoStatement* stmt ) override;
 
-	virtual void VisitConst( ILConst* node ) override;
-	virtual void VisitUnary( ILUnary* node ) override;
-	virtual void VisitBinary( ILBinary* node ) override;
-	virtual void VisitLocalVar( ILLocalVar* node ) override;
-	virtual void VisitGlobalVar( ILGlobalVar* node ) override;
-	virtual void VisitHeapVar( ILHeapVar* node ) override;
-	virtual void VisitArrayElementVar( ILArrayElementVar* node ) override;
-	virtual void VisitFieldVar( ILFieldVar* node ) override;
-	virtual void VisitTempVar( ILTempVar* node ) override;
-	virtual void VisitLoad( ILLoad* node ) override;
-	virtual void VisitStore( ILStore* node ) override;
-	virtual void VisitJump( ILJump* node ) override;
-	virtual void VisitJumpCond( ILJumpCond* node ) override;
-	virtual void VisitCall( ILCall* node ) override;
-	virtual void VisitNative( ILNative* node ) override;
-	virtual void VisitReturn( ILReturn* node ) override;
-	virtual void VisitPhi( ILPhi* node ) override;
-	virtual void VisitInterval( ILInterval* node ) override;
+	void VisitConst( ILConst* node );
+	void VisitUnary( ILUnary* node );
+	void VisitBinary( ILBinary* node );
+	void VisitLocalVar( ILLocalVar* node );
+	void VisitGlobalVar( ILGlobalVar* node );
+	void VisitHeapVar( ILHeapVar* node );
+	void VisitArrayElementVar( ILArrayElementVar* node );
+	void VisitFieldVar( ILFieldVar* node );
+	void VisitTempVar( ILTempVar* node );
+	void VisitLoad( ILLoad* node );
+	void VisitStore( ILStore* node );
+	void VisitJump( ILJump* node );
+	void VisitJumpCond( ILJumpCond* node );
+	void VisitCall( ILCall* node );
+	void VisitNative( ILNative* node );
+	void VisitReturn( ILReturn* node );
+	void VisitPhi( ILPhi* node );
+	void VisitInterval( ILInterval* node );
 private:
 	void Visit( Statement* stmt );
 	std::string Build( ILNode* node );
@@ -50,7 +52,8 @@ private:
 	void Indent();
 	void Dedent();
 
-	std::string BuildStringLiteral( const char* str );
+	// Literal for the string in .data at addr
+	std::string BuildStringLiteral( cell_t addr );
 	std::string BuildEscapedChar( char c, char quote );
 
 	bool IsPossibleString( cell_t val ) const;
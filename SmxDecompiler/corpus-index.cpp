@@ -0,0 +1,316 @@
+#include "corpus-index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <unordered_map>
+#include "xrefs.h"
+#include "fingerprint.h"
+
+// Everything taken from a single file, filled in on the worker threads
+struct IndexedFile
+{
+	struct Function
+	{
+		cell_t start;
+		std::string name;
+		uint64_t hash;
+	};
+	struct Term
+	{
+		CorpusIndex::TermKind kind;
+		std::string text;
+		cell_t func;
+	};
+
+	std::vector<Function> functions;
+	std::vector<Term> terms;
+};
+
+static void IndexFile( const std::string& path, IndexedFile& out )
+{
+	SmxFile smx( path.c_str() );
+	if( smx.code_size() == 0 )
+		return;
+
+	XrefIndex xrefs( smx );
+	for( size_t i = 0; i < xrefs.num_functions(); i++ )
+	{
+		cell_t start = xrefs.function( i );
+		cell_t end = i + 1 < xrefs.num_functions() ? xrefs.function( i + 1 ) : (cell_t)smx.code_size();
+
+		IndexedFile::Function func;
+		func.start = start;
+		func.name = xrefs.FunctionName( start );
+		func.hash = FingerprintDb::Fingerprint( smx, start, end );
+
+		// Unnamed functions only get a made up name, that isn't worth searching for
+		SmxFunction* named = smx.FindFunctionAt( start );
+		if( named && named->pcode_start == start && named->name )
+			out.terms.push_back( { CorpusIndex::TermKind::FUNCTION, func.name, start } );
+
+		char hash[17];
+		snprintf( hash, sizeof( hash ), "%016llx", (unsigned long long)func.hash );
+		out.terms.push_back( { CorpusIndex::TermKind::HASH, hash, start } );
+
+		out.functions.push_back( std::move( func ) );
+	}
+
+	for( size_t i = 0; i < xrefs.num_xrefs(); i++ )
+	{
+		const XrefIndex::Xref& xref = xrefs.xref( i );
+		if( xref.kind == XrefIndex::Kind::NATIVE )
+			out.terms.push_back( { CorpusIndex::TermKind::NATIVE, xrefs.TargetName( xref ), xref.func } );
+		else if( xref.kind == XrefIndex::Kind::DATA_REF )
+			out.terms.push_back( { CorpusIndex::TermKind::STRING, xrefs.TargetName( xref ), xref.func } );
+	}
+}
+
+static bool ComparePostings( const CorpusIndex::Posting& a, const CorpusIndex::Posting& b )
+{
+	if( a.file != b.file )
+		return a.file < b.file;
+	return a.func < b.func;
+}
+
+static bool EqualPostings( const CorpusIndex::Posting& a, const CorpusIndex::Posting& b )
+{
+	return a.file == b.file && a.func == b.func;
+}
+
+bool CorpusIndex::Build( const std::vector<std::string>& files, const char* out_path, unsigned int num_threads )
+{
+	std::vector<IndexedFile> indexed( files.size() );
+
+	// Files are handed out one at a time, they vary a lot in size
+	std::atomic<size_t> next_file( 0 );
+	auto Worker = [&]() {
+		for( size_t i = next_file++; i < files.size(); i = next_file++ )
+			IndexFile( files[i], indexed[i] );
+	};
+
+	std::vector<std::thread> threads;
+	for( unsigned int i = 1; i < num_threads; i++ )
+		threads.emplace_back( Worker );
+	Worker();
+	for( std::thread& thread : threads )
+		thread.join();
+
+	// Strings are shared between all tables, offset 0 is the empty string
+	std::string strings( 1, '\0' );
+	std::unordered_map<std::string, uint32_t> string_offsets;
+	auto AddString = [&]( const std::string& str ) -> uint32_t {
+		auto it = string_offsets.find( str );
+		if( it != string_offsets.end() )
+			return it->second;
+
+		uint32_t offset = (uint32_t)strings.size();
+		strings.append( str.c_str(), str.size() + 1 );
+		string_offsets.emplace( str, offset );
+		return offset;
+	};
+
+	std::vector<uint32_t> file_table;
+	std::vector<Function> function_table;
+	std::map<std::pair<uint32_t, std::string>, std::vector<Posting>> postings;
+	for( size_t i = 0; i < files.size(); i++ )
+	{
+		// Stored absolute so results can be opened from anywhere, not just where the index was built
+		std::error_code error;
+		std::filesystem::path path = std::filesystem::absolute( files[i], error );
+		uint32_t file = (uint32_t)file_table.size();
+		file_table.push_back( AddString( error ? files[i] : path.string() ) );
+
+		for( const IndexedFile::Function& func : indexed[i].functions )
+			function_table.push_back( { file, func.start, AddString( func.name ), (uint32_t)func.hash, (uint32_t)(func.hash >> 32) } );
+		for( const IndexedFile::Term& term : indexed[i].terms )
+			postings[{ (uint32_t)term.kind, term.text }].push_back( { file, term.func } );
+
+		indexed[i] = IndexedFile();
+	}
+
+	std::vector<Term> term_table;
+	std::vector<Posting> posting_table;
+	for( auto& entry : postings )
+	{
+		std::vector<Posting>& list = entry.second;
+		std::sort( list.begin(), list.end(), ComparePostings );
+		list.erase( std::unique( list.begin(), list.end(), EqualPostings ), list.end() );
+
+		term_table.push_back( { entry.first.first, AddString( entry.first.second ), (uint32_t)posting_table.size(), (uint32_t)list.size() } );
+		posting_table.insert( posting_table.end(), list.begin(), list.end() );
+	}
+
+	Header header;
+	memcpy( header.magic, kMagic, sizeof( header.magic ) );
+	header.num_files = (uint32_t)file_table.size();
+	header.num_functions = (uint32_t)function_table.size();
+	header.num_terms = (uint32_t)term_table.size();
+	header.num_postings = (uint32_t)posting_table.size();
+	header.strings_size = (uint32_t)strings.size();
+
+	std::ofstream out( out_path, std::ios::binary );
+	out.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+	out.write( reinterpret_cast<const char*>( file_table.data() ), file_table.size() * sizeof( uint32_t ) );
+	out.write( reinterpret_cast<const char*>( function_table.data() ), function_table.size() * sizeof( Function ) );
+	out.write( reinterpret_cast<const char*>( term_table.data() ), term_table.size() * sizeof( Term ) );
+	out.write( reinterpret_cast<const char*>( posting_table.data() ), posting_table.size() * sizeof( Posting ) );
+	out.write( strings.data(), strings.size() );
+	return out.good();
+}
+
+bool CorpusIndex::Load( const char* path )
+{
+	std::ifstream file( path, std::ios::binary | std::ios::ate );
+	if( !file )
+		return false;
+
+	size_t size = (size_t)file.tellg();
+	if( size < sizeof( Header ) )
+		return false;
+
+	image_ = std::make_unique<char[]>( size );
+	file.seekg( 0, std::ios::beg );
+	file.read( image_.get(), size );
+	if( !file )
+		return false;
+
+	header_ = reinterpret_cast<const Header*>( image_.get() );
+	if( memcmp( header_->magic, kMagic, sizeof( kMagic ) ) != 0 )
+		return false;
+
+	size_t expected_size = sizeof( Header ) +
+		(size_t)header_->num_files * sizeof( uint32_t ) +
+		(size_t)header_->num_functions * sizeof( Function ) +
+		(size_t)header_->num_terms * sizeof( Term ) +
+		(size_t)header_->num_postings * sizeof( Posting ) +
+		header_->strings_size;
+	if( size != expected_size )
+		return false;
+
+	const char* p = image_.get() + sizeof( Header );
+	files_ = reinterpret_cast<const uint32_t*>( p );
+	p += header_->num_files * sizeof( uint32_t );
+	functions_ = reinterpret_cast<const Function*>( p );
+	p += header_->num_functions * sizeof( Function );
+	terms_ = reinterpret_cast<const Term*>( p );
+	p += header_->num_terms * sizeof( Term );
+	postings_ = reinterpret_cast<const Posting*>( p );
+	p += header_->num_postings * sizeof( Posting );
+	strings_ = p;
+
+	// The tables are used without any further checks, so everything they refer to has to be in
+	// range. Strings can't run off the end as long as the last one is terminated
+	if( header_->strings_size == 0 || strings_[header_->strings_size - 1] != '\0' )
+		return false;
+	for( uint32_t i = 0; i < header_->num_files; i++ )
+	{
+		if( files_[i] >= header_->strings_size )
+			return false;
+	}
+	for( uint32_t i = 0; i < header_->num_functions; i++ )
+	{
+		if( functions_[i].file >= header_->num_files || functions_[i].name >= header_->strings_size )
+			return false;
+	}
+	for( uint32_t i = 0; i < header_->num_terms; i++ )
+	{
+		const Term& term = terms_[i];
+		if( term.text >= header_->strings_size || term.first_posting > header_->num_postings ||
+			term.num_postings > header_->num_postings - term.first_posting )
+			return false;
+	}
+	for( uint32_t i = 0; i < header_->num_postings; i++ )
+	{
+		if( postings_[i].file >= header_->num_files )
+			return false;
+	}
+	return true;
+}
+
+const char* CorpusIndex::FunctionName( uint32_t file, cell_t func ) const
+{
+	const Function* end = functions_ + header_->num_functions;
+	const Function* it = std::lower_bound( functions_, end, Posting{ file, func },
+		[]( const Function& a, const Posting& b ) {
+			if( a.file != b.file )
+				return a.file < b.file;
+			return a.start < b.func;
+		} );
+	if( it == end || it->file != file || it->start != func )
+		return nullptr;
+	return string( it->name );
+}
+
+CorpusIndex::Range CorpusIndex::Find( TermKind kind, const char* text ) const
+{
+	const Term* end = terms_ + header_->num_terms;
+	const Term* it = std::lower_bound( terms_, end, text,
+		[this, kind]( const Term& term, const char* text ) {
+			if( term.kind != (uint32_t)kind )
+				return term.kind < (uint32_t)kind;
+			return strcmp( string( term.text ), text ) < 0;
+		} );
+	if( it == end || it->kind != (uint32_t)kind || strcmp( string( it->text ), text ) != 0 )
+		return { nullptr, nullptr };
+	return { postings_ + it->first_posting, postings_ + it->first_posting + it->num_postings };
+}
+
+std::vector<CorpusIndex::Posting> CorpusIndex::FindContaining( TermKind kind, const char* text ) const
+{
+	const Term* end = terms_ + header_->num_terms;
+	const Term* it = std::lower_bound( terms_, end, kind,
+		[]( const Term& term, TermKind kind ) { return term.kind < (uint32_t)kind; } );
+
+	std::vector<Posting> result;
+	for( ; it != end && it->kind == (uint32_t)kind; ++it )
+	{
+		if( strstr( string( it->text ), text ) )
+			result.insert( result.end(), postings_ + it->first_posting, postings_ + it->first_posting + it->num_postings );
+	}
+
+	std::sort( result.begin(), result.end(), ComparePostings );
+	result.erase( std::unique( result.begin(), result.end(), EqualPostings ), result.end() );
+	return result;
+}
+
+std::vector<CorpusIndex::Posting> CorpusIndex::Run( const Query& query ) const
+{
+	std::vector<std::vector<Posting>> lists;
+	auto AddExact = [&]( TermKind kind, const char* text ) {
+		Range range = Find( kind, text );
+		lists.emplace_back( range.first, range.second );
+	};
+
+	if( query.function )
+		AddExact( TermKind::FUNCTION, query.function );
+	if( query.native )
+		AddExact( TermKind::NATIVE, query.native );
+	if( query.hash )
+		AddExact( TermKind::HASH, query.hash );
+	if( query.string )
+		lists.push_back( FindContaining( TermKind::STRING, query.string ) );
+
+	if( lists.empty() )
+		return {};
+
+	// Start from the shortest list so the intersections stay small
+	std::sort( lists.begin(), lists.end(),
+		[]( const std::vector<Posting>& a, const std::vector<Posting>& b ) { return a.size() < b.size(); } );
+
+	std::vector<Posting> result = std::move( lists[0] );
+	for( size_t i = 1; i < lists.size() && !result.empty(); i++ )
+	{
+		std::vector<Posting> intersection;
+		std::set_intersection( result.begin(), result.end(), lists[i].begin(), lists[i].end(),
+			std::back_inserter( intersection ), ComparePostings );
+		result = std::move( intersection );
+	}
+	return result;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "smx-file.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+// Inverted index over many .smx files, for finding which plugins (and functions in them) use a
+// native, reference a string and so on without decompiling or even loading any of them.
+//
+// Files are indexed from their bytecode only (see XrefIndex). On disk the index is a header followed
+// by flat arrays of 32-bit fields, so it is used straight from the loaded image:
+//   files      path
+//   functions  file, start, name, hash (lo/hi), sorted by file and start
+//   terms      kind, text, first posting, posting count, sorted by kind and text
+//   postings   file, function start, sorted per term
+//   strings    NUL-terminated text referenced by offset from the tables above
+class CorpusIndex
+{
+public:
+	enum class TermKind : uint32_t
+	{
+		FUNCTION, // Function name
+		NATIVE,   // Name of a native called by the function
+		STRING,   // String from .data referenced by the function
+		HASH      // Fingerprint of the function's code (see FingerprintDb), as 16 hex digits
+	};
+
+	struct Posting
+	{
+		uint32_t file;
+		cell_t func;
+	};
+
+	struct Query
+	{
+		const char* function = nullptr; // Exact function name
+		const char* native = nullptr;   // Exact native name
+		const char* string = nullptr;   // Substring of a referenced string
+		const char* hash = nullptr;     // Exact function hash
+	};
+
+	using Range = std::pair<const Posting*, const Posting*>;
+
+	// Indexes the files on the given number of threads and writes the index to out_path, returns
+	// false if it couldn't be written. Files that aren't valid .smx files are skipped
+	static bool Build( const std::vector<std::string>& files, const char* out_path, unsigned int num_threads );
+
+	bool Load( const char* path );
+
+	size_t num_files() const { return header_->num_files; }
+	const char* file( size_t index ) const { return string( files_[index] ); }
+	// Name of the function at func in file, or nullptr if there is no such function
+	const char* FunctionName( uint32_t file, cell_t func ) const;
+
+	// Postings of the term, in order of file and function
+	Range Find( TermKind kind, const char* text ) const;
+	// Postings of every term of the kind containing text, in order of file and function
+	std::vector<Posting> FindContaining( TermKind kind, const char* text ) const;
+	// Functions matching every part of the query that is set
+	std::vector<Posting> Run( const Query& query ) const;
+private:
+	struct Header
+	{
+		char magic[8];
+		uint32_t num_files;
+		uint32_t num_functions;
+		uint32_t num_terms;
+		uint32_t num_postings;
+		uint32_t strings_size;
+	};
+	struct Function
+	{
+		uint32_t file;
+		cell_t start;
+		uint32_t name;
+		uint32_t hash_lo;
+		uint32_t hash_hi;
+	};
+	struct Term
+	{
+		uint32_t kind;
+		uint32_t text;
+		uint32_t first_posting;
+		uint32_t num_postings;
+	};
+
+	static constexpr char kMagic[8] = { 'S', 'M', 'X', 'I', 'D', 'X', '\0', '\1' };
+
+	const char* string( uint32_t offset ) const { return strings_ + offset; }
+private:
+	std::unique_ptr<char[]> image_;
+	const Header* header_ = nullptr;
+	const uint32_t* files_ = nullptr;
+	const Function* functions_ = nullptr;
+	const Term* terms_ = nullptr;
+	const Posting* postings_ = nullptr;
+	const char* strings_ = nullptr;
+};
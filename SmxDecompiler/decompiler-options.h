@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 enum class StringDetectType
 {
 	NONE,       // Won't attempt to detect strings
@@ -7,6 +9,19 @@ enum class StringDetectType
 	COMMENT,    // Places comment next to the constant of what string it could be
 };
 
+enum class OutputFormat
+{
+	TEXT,   // Plain code, with assembly/IL before each function if requested
+	NDJSON, // One JSON object per line for each function
+};
+
+enum class KnownFunctionMode
+{
+	NONE, // Known functions aren't looked for
+	NAME, // Unnamed functions matching a known function get its name
+	SKIP, // As NAME, and functions matching a known function aren't decompiled
+};
+
 struct DecompilerOptions
 {
 	bool print_globals;
@@ -14,4 +29,11 @@ struct DecompilerOptions
 	bool print_assembly;
 	const char* function;
 	StringDetectType string_detect;
+	OutputFormat format = OutputFormat::TEXT;
+	// Limits per function, past which it is given up on and only disassembled (0 for no limit)
+	double max_function_ms = 0.0;
+	size_t max_function_bytes = 0;
+	unsigned int num_threads = 1;
+	KnownFunctionMode known_mode = KnownFunctionMode::NONE;
+	const class FingerprintDb* known_functions = nullptr;
 };
\ No newline at end of file
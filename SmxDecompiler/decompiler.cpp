@@ -1,6 +1,13 @@
 #include "decompiler.h"
 
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #include "smx-disasm.h"
 #include "cfg-builder.h"
@@ -10,14 +17,44 @@
 #include "code-fixer.h"
 #include "structurizer.h"
 #include "code-writer.h"
+#include "json.h"
+#include "fingerprint.h"
+#include "budget.h"
+#include "xrefs.h"
+#include "trace.h"
 
 Decompiler::Decompiler( SmxFile& smx, const DecompilerOptions& options ) :
 	smx_( &smx ),
 	options_( options )
-{}
+{
+	if( options_.known_mode == KnownFunctionMode::NONE || !options_.known_functions )
+		return;
+
+	known_ = options_.known_functions->Match( smx );
+	for( const auto& known : known_ )
+	{
+		// Functions that aren't in any table would only be found while decompiling their callers
+		SmxFunction* func = smx_->FindFunctionAt( known.first );
+		if( !func )
+		{
+			smx_->AddFunction( known.first );
+			func = smx_->FindFunctionAt( known.first );
+		}
+		if( func && func->pcode_start == known.first && !func->name )
+			func->name = known.second;
+	}
+}
 
 void Decompiler::Print()
 {
+	if( options_.format == OutputFormat::NDJSON )
+	{
+		if( options_.print_globals )
+			PrintGlobalsJson();
+		Decompile( [this]( const DecompiledFunction& result ) { PrintJson( result ); } );
+		return;
+	}
+
 	if( options_.print_globals )
 	{
 		for( size_t i = 0; i < smx_->num_globals(); i++ )
@@ -29,50 +66,305 @@ void Decompiler::Print()
 		std::cout << std::endl;
 	}
 
+	Decompile( []( const DecompiledFunction& result ) {
+		if( !result.assembly.empty() )
+			std::cout << result.assembly.c_str() << std::endl;
+		std::cout << result.il;
+		std::cout << result.code << std::endl;
+	} );
+}
+
+DecompiledFunction Decompiler::Decompile( SmxFunction& func )
+{
+	using Clock = std::chrono::steady_clock;
+	auto ElapsedMs = []( Clock::time_point start ) {
+		return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+	};
+
+	DecompiledFunction result;
+	result.function = &func;
+
+	// Naming the function isn't free, only done when it goes anywhere
+	TraceFunction trace( Trace::enabled() ? CodeWriter( *smx_, &func ).FunctionName() : std::string() );
+
+	if( options_.known_mode == KnownFunctionMode::SKIP )
+	{
+		auto known = known_.find( func.pcode_start );
+		if( known != known_.end() )
+		{
+			CodeWriter writer( *smx_, &func );
+			result.known_as = known->second;
+			result.name = writer.FunctionName();
+			result.signature = writer.BuildFuncDecl( result.name, &func.signature() );
+			result.code = "// " + result.signature + ": matches known function " + known->second + ", not decompiled\n";
+			return result;
+		}
+	}
+
+	std::optional<DecompileBudget> budget;
+	if( options_.max_function_ms > 0.0 || options_.max_function_bytes )
+		budget.emplace( options_.max_function_ms, options_.max_function_bytes );
+
+	const char* stage = "disassembling";
+	try
+	{
+		auto start = Clock::now();
+		if( options_.print_assembly )
+			result.assembly = Disassemble( func );
+		result.disassemble_ms = ElapsedMs( start );
+
+		stage = "lifting";
+		start = Clock::now();
+		ILControlFlowGraph* ilcfg = Lift( func );
+		if( options_.print_il )
+			result.il = DisassembleIL( *ilcfg );
+		result.lift_ms = ElapsedMs( start );
+
+		stage = "building code";
+		start = Clock::now();
+		result.code = BuildCode( func, *ilcfg );
+		result.build_code_ms = ElapsedMs( start );
+	}
+	catch( const BudgetExceeded& exceeded )
+	{
+		result.budget_exceeded = true;
+		result.il.clear();
+		result.errors.push_back( std::string( "exceeded " ) + exceeded.limit + " budget while " + stage );
+	}
+
+	CodeWriter writer( *smx_, &func );
+	result.name = writer.FunctionName();
+	result.signature = writer.BuildFuncDecl( result.name, &func.signature() );
+
+	// Disassembly doesn't run any of the checks, so it is always there to fall back on
+	if( result.budget_exceeded )
+		result.code = "// " + result.signature + ": " + result.errors.back() + ", disassembly follows\n/*\n" + Disassemble( func ) + "*/\n";
+
+	return result;
+}
+
+void Decompiler::Decompile( const DecompileSink& sink )
+{
+	if( options_.num_threads > 1 )
+	{
+		DecompileParallel( sink );
+		return;
+	}
+
+	// Decompiling can discover new functions, which get appended and picked up by later iterations
 	for( size_t i = 0; i < smx_->num_functions(); i++ )
 	{
 		SmxFunction& func = smx_->function( i );
-		if( options_.function && func.name && strcmp( func.name, options_.function ) != 0 )
+		if( !IsSelected( func ) )
 			continue;
 
-		if( options_.print_assembly )
-		{
-			SmxDisassembler disasm( *smx_ );
-			std::cout << disasm.DisassembleFunction( func ).c_str() << std::endl;
-		}
+		DecompiledFunction result = Decompile( func );
+		if( options_.format == OutputFormat::NDJSON )
+			result.predicted_cost = EstimateCost( func );
+		sink( result );
+	}
+}
 
-		CfgBuilder builder( *smx_ );
-		ControlFlowGraph cfg = builder.Build( smx_->code( func.pcode_start ) );
+void Decompiler::DecompileParallel( const DecompileSink& sink )
+{
+	// Every function has to be known up front since the order is fixed before anything is decompiled,
+	// so discovered functions come in order of address instead of order of discovery
+	XrefIndex xrefs( *smx_ );
+	for( size_t i = 0; i < xrefs.num_functions(); i++ )
+	{
+		if( !smx_->FindFunctionAt( xrefs.function( i ) ) )
+			smx_->AddFunction( xrefs.function( i ) );
+	}
 
-		DiscoverFunctions( cfg );
+	std::vector<SmxFunction*> functions;
+	for( size_t i = 0; i < smx_->num_functions(); i++ )
+	{
+		SmxFunction& func = smx_->function( i );
+		if( IsSelected( func ) )
+			functions.push_back( &func );
+	}
 
-		PcodeLifter lifter( *smx_ );
-		ILControlFlowGraph* ilcfg = lifter.Lift( cfg );
+	// Largest first, so the pool isn't left waiting on a big function that was started last
+	std::vector<std::pair<double, size_t>> jobs;
+	jobs.reserve( functions.size() );
+	for( size_t i = 0; i < functions.size(); i++ )
+		jobs.emplace_back( EstimateCost( *functions[i] ), i );
+	std::stable_sort( jobs.begin(), jobs.end(),
+		[]( const std::pair<double, size_t>& a, const std::pair<double, size_t>& b ) { return a.first > b.first; } );
 
-		if( options_.print_il )
+	// Finished results wait here until everything before them has been passed to the sink
+	std::vector<DecompiledFunction> results( functions.size() );
+	std::vector<bool> finished( functions.size(), false );
+	size_t next_result = 0;
+	std::mutex mutex;
+
+	std::atomic<size_t> next_job( 0 );
+	auto Worker = [&]() {
+		Decompiler decompiler( *this );
+		for( size_t job = next_job++; job < jobs.size(); job = next_job++ )
 		{
-			ILDisassembler ildisasm( *smx_ );
-			std::cout << ildisasm.DisassembleCFG( *ilcfg );
+			size_t index = jobs[job].second;
+			DecompiledFunction result = decompiler.Decompile( *functions[index] );
+			result.predicted_cost = jobs[job].first;
+
+			std::lock_guard<std::mutex> lock( mutex );
+			results[index] = std::move( result );
+			finished[index] = true;
+			for( ; next_result < results.size() && finished[next_result]; next_result++ )
+			{
+				sink( results[next_result] );
+				results[next_result] = DecompiledFunction();
+			}
 		}
+	};
+
+	std::vector<std::thread> threads;
+	for( unsigned int i = 1; i < options_.num_threads; i++ )
+		threads.emplace_back( Worker );
+	Worker();
+	for( std::thread& thread : threads )
+		thread.join();
+}
+
+double Decompiler::EstimateCost( const SmxFunction& func ) const
+{
+	// Dominance and interval construction are iterative over the blocks, which is what makes big
+	// functions expensive
+	static constexpr double kPerInstruction = 0.002;
+	static constexpr double kPerBlock = 0.01;
+	static constexpr double kPerBlockSquared = 0.00005;
+	static constexpr double kPerCase = 0.005;
+
+	CfgBuilder builder( *smx_ );
+	CfgBuilder::Size size = builder.Measure( smx_->code( func.pcode_start ) );
+
+	double blocks = (double)size.leaders;
+	return kPerInstruction * size.instructions + kPerBlock * blocks + kPerBlockSquared * blocks * blocks +
+		kPerCase * size.cases;
+}
+
+void Decompiler::PrintGlobalsJson()
+{
+	JsonWriter json;
+	json.BeginObject().Key( "globals" ).BeginArray();
+	for( size_t i = 0; i < smx_->num_globals(); i++ )
+	{
+		SmxVariable& var = smx_->global( i );
+		CodeWriter writer( *smx_, nullptr );
+		json.BeginObject()
+			.Key( "name" ).String( var.name )
+			.Key( "address" ).Number( (int64_t)var.address )
+			.Key( "decl" ).String( writer.BuildVarDecl( var.name, &var.type ) )
+			.EndObject();
+	}
+	json.EndArray().EndObject();
+
+	std::cout << json.str() << std::endl;
+}
+
+void Decompiler::PrintJson( const DecompiledFunction& result )
+{
+	const SmxFunction& func = *result.function;
+
+	JsonWriter json;
+	json.BeginObject()
+		.Key( "name" ).String( result.name )
+		.Key( "start" ).Number( (int64_t)func.pcode_start )
+		.Key( "end" ).Number( (int64_t)func.pcode_end )
+		.Key( "public" ).Bool( func.is_public )
+		.Key( "signature" ).String( result.signature )
+		.Key( "code" ).String( result.code );
+	if( options_.print_il )
+		json.Key( "il" ).String( result.il );
+	if( options_.print_assembly )
+		json.Key( "assembly" ).String( result.assembly );
+	if( result.known_as )
+		json.Key( "known_as" ).String( result.known_as );
+
+	json.Key( "stats" ).BeginObject()
+		.Key( "disassemble_ms" ).Number( result.disassemble_ms )
+		.Key( "lift_ms" ).Number( result.lift_ms )
+		.Key( "build_code_ms" ).Number( result.build_code_ms )
+		.Key( "budget_exceeded" ).Bool( result.budget_exceeded )
+		.Key( "predicted_cost" ).Number( result.predicted_cost )
+		.EndObject();
+
+	json.Key( "errors" ).BeginArray();
+	for( const std::string& error : result.errors )
+		json.String( error );
+	json.EndArray();
+
+	json.EndObject();
+
+	// Written in one go and flushed so that output from parallel workers doesn't interleave
+	std::string line = json.str() + '\n';
+	std::cout.write( line.data(), line.size() );
+	std::cout.flush();
+}
 
-		Typer typer( *smx_ );
-		typer.PopulateTypes( *ilcfg );
+bool Decompiler::IsSelected( const SmxFunction& func ) const
+{
+	return !options_.function || !func.name || strcmp( func.name, options_.function ) == 0;
+}
 
-		CodeFixer fixer( *smx_ );
-		for( int i = 0; i < 3; i++ )
+std::string Decompiler::Disassemble( const SmxFunction& func )
+{
+	TraceSpan span( "SmxDisassembler" );
+	SmxDisassembler disasm( *smx_ );
+	return disasm.DisassembleFunction( func );
+}
+
+ILControlFlowGraph* Decompiler::Lift( const SmxFunction& func )
+{
+	CfgBuilder builder( *smx_ );
+	ControlFlowGraph cfg = builder.Build( smx_->code( func.pcode_start ) );
+
+	DiscoverFunctions( cfg );
+
+	PcodeLifter lifter( *smx_ );
+	return lifter.Lift( cfg );
+}
+
+std::string Decompiler::DisassembleIL( const ILControlFlowGraph& ilcfg )
+{
+	TraceSpan span( "ILDisassembler" );
+	ILDisassembler ildisasm( *smx_ );
+	return ildisasm.DisassembleCFG( ilcfg );
+}
+
+std::string Decompiler::BuildCode( SmxFunction& func, ILControlFlowGraph& ilcfg )
+{
+	Typer typer( *smx_ );
+	{
+		TraceSpan span( "Typer" );
+		typer.PopulateTypes( ilcfg );
+	}
+
+	CodeFixer fixer( *smx_ );
+	for( int i = 0; i < 3; i++ )
+	{
 		{
-			typer.PopulateTypes( *ilcfg );
-			fixer.ApplyFixes( *ilcfg );
-			typer.PropagateTypes( *ilcfg );
+			TraceSpan span( "Typer" );
+			typer.PopulateTypes( ilcfg );
 		}
+		{
+			TraceSpan span( "CodeFixer" );
+			fixer.ApplyFixes( ilcfg );
+		}
+		TraceSpan span( "Typer" );
+		typer.PropagateTypes( ilcfg );
+	}
 
-		Structurizer structurizer( ilcfg );
-		Statement* func_stmt = structurizer.Transform();
-
-		CodeWriter writer( *smx_, &func, options_.string_detect );
-		std::string code = writer.Build( func_stmt );
-		std::cout << code << std::endl;
+	Statement* func_stmt;
+	{
+		TraceSpan span( "Structurizer" );
+		Structurizer structurizer( &ilcfg );
+		func_stmt = structurizer.Transform();
 	}
+
+	TraceSpan span( "CodeWriter" );
+	CodeWriter writer( *smx_, &func, options_.string_detect );
+	return writer.Build( func_stmt );
 }
 
 void Decompiler::DiscoverFunctions( ControlFlowGraph& cfg )
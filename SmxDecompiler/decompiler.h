@@ -2,18 +2,73 @@
 
 #include "smx-file.h"
 #include "decompiler-options.h"
+#include <string>
+#include <functional>
+#include <vector>
+#include <unordered_map>
 
+// Everything produced for a single function
+struct DecompiledFunction
+{
+	SmxFunction* function = nullptr;
+	std::string name;
+	std::string signature;
+	std::string code;
+	std::string il;       // Only filled in if print_il is set
+	std::string assembly; // Only filled in if print_assembly is set
+	const char* known_as = nullptr; // Name of the known function it matched, if it was skipped
+
+	// Time spent in each stage, in milliseconds
+	double disassemble_ms = 0.0;
+	double lift_ms = 0.0;
+	double build_code_ms = 0.0;
+	// What EstimateCost expected the function to take, to compare against the times above. Only set
+	// when decompiling all functions, in parallel or with ndjson output
+	double predicted_cost = 0.0;
+	// Set if a limit of the budget was hit, code is then the disassembly instead
+	bool budget_exceeded = false;
+
+	// Problems hit while decompiling that didn't stop code from being produced
+	std::vector<std::string> errors;
+};
+
+using DecompileSink = std::function<void( const DecompiledFunction& result )>;
+
+// Decompiler doesn't print or keep any per-function state, so multiple threads can decompile
+// functions from the same or different files at once (each thread with its own Decompiler)
 class Decompiler
 {
 public:
 	Decompiler( SmxFile& smx, const DecompilerOptions& options );
 
+	// Prints the globals and all selected functions to stdout
 	void Print();
 
+	DecompiledFunction Decompile( SmxFunction& func );
+	// Decompiles all selected functions, including any discovered while decompiling, in order.
+	// With more than one thread in the options, the functions are decompiled in parallel, most
+	// expensive first, and still passed to the sink in order
+	void Decompile( const DecompileSink& sink );
+
+	// Rough estimate of how long the function takes to decompile, in milliseconds
+	double EstimateCost( const SmxFunction& func ) const;
+
+	std::string Disassemble( const SmxFunction& func );
+	// Builds the CFG for the function and lifts it to IL, newly found callees are added to the SmxFile
+	class ILControlFlowGraph* Lift( const SmxFunction& func );
+	std::string DisassembleIL( const class ILControlFlowGraph& ilcfg );
+	// Runs typing, fixes and structuring over the lifted IL and writes out the code for it
+	std::string BuildCode( SmxFunction& func, class ILControlFlowGraph& ilcfg );
+
 private:
+	bool IsSelected( const SmxFunction& func ) const;
+	void DecompileParallel( const DecompileSink& sink );
+	void PrintGlobalsJson();
+	void PrintJson( const DecompiledFunction& result );
 	void DiscoverFunctions( class ControlFlowGraph& cfg );
 
 private:
 	SmxFile* smx_;
 	DecompilerOptions options_;
+	std::unordered_map<cell_t, const char*> known_; // Known name of each recognized function start
 };
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "diff.h"
+
+#include <iostream>
+#include <cstring>
+#include <unordered_map>
+#include "xrefs.h"
+#include "fingerprint.h"
+#include "decompiler.h"
+#include "json.h"
+
+static uint64_t HashName( uint64_t hash, XrefIndex::Kind kind, const char* name )
+{
+	// FNV-1a, the kind keeps a call and a global use of the same name apart
+	hash ^= (uint8_t)kind;
+	hash *= 0x100000001b3ULL;
+	for( const char* c = name; *c; c++ )
+	{
+		hash ^= (unsigned char)*c;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static SmxFunction* FindOrAddFunction( SmxFile& smx, cell_t start )
+{
+	SmxFunction* func = smx.FindFunctionAt( start );
+	if( !func )
+	{
+		smx.AddFunction( start );
+		func = smx.FindFunctionAt( start );
+	}
+	return func;
+}
+
+PluginDiff::PluginDiff( SmxFile& old_smx, SmxFile& new_smx ) :
+	old_smx_( &old_smx ),
+	new_smx_( &new_smx )
+{
+	old_functions_ = CollectFunctions( old_smx );
+	new_functions_ = CollectFunctions( new_smx );
+	Match();
+}
+
+std::vector<PluginDiff::Function> PluginDiff::CollectFunctions( SmxFile& smx )
+{
+	std::vector<Function> functions;
+	if( smx.code_size() == 0 )
+		return functions;
+
+	// Only named callees can be compared across files, unnamed ones are named after their address
+	std::unordered_map<cell_t, const char*> names;
+	for( size_t i = 0; i < smx.num_functions(); i++ )
+	{
+		SmxFunction& func = smx.function( i );
+		if( func.name )
+			names.emplace( func.pcode_start, func.name );
+	}
+
+	XrefIndex xrefs( smx );
+	functions.reserve( xrefs.num_functions() );
+	for( size_t i = 0; i < xrefs.num_functions(); i++ )
+	{
+		cell_t start = xrefs.function( i );
+		cell_t end = i + 1 < xrefs.num_functions() ? xrefs.function( i + 1 ) : (cell_t)smx.code_size();
+
+		// The fingerprint leaves out call targets and global addresses, their names still matter here
+		uint64_t hash = FingerprintDb::Fingerprint( smx, start, end );
+		XrefIndex::Range refs = xrefs.From( start );
+		for( const XrefIndex::Xref* xref = refs.first; xref != refs.second; ++xref )
+		{
+			const char* name = nullptr;
+			if( xref->kind == XrefIndex::Kind::CALL )
+			{
+				auto it = names.find( xref->target );
+				name = it != names.end() ? it->second : nullptr;
+			}
+			else if( xref->kind == XrefIndex::Kind::GLOBAL_READ || xref->kind == XrefIndex::Kind::GLOBAL_WRITE ||
+				xref->kind == XrefIndex::Kind::GLOBAL_ADDR )
+			{
+				SmxVariable* var = smx.FindGlobalAt( xref->target );
+				name = var ? var->name : nullptr;
+			}
+			else
+			{
+				continue;
+			}
+
+			hash = HashName( hash, xref->kind, name ? name : "" );
+		}
+
+		auto name = names.find( start );
+		Function func;
+		func.start = start;
+		func.named = name != names.end();
+		func.name = func.named ? name->second : xrefs.FunctionName( start );
+		func.hash = hash;
+		functions.push_back( std::move( func ) );
+	}
+	return functions;
+}
+
+void PluginDiff::Match()
+{
+	std::vector<Entry> changed( new_functions_.size() );
+	std::vector<bool> has_change( new_functions_.size(), false );
+
+	std::unordered_map<std::string, size_t> old_by_name;
+	for( size_t i = 0; i < old_functions_.size(); i++ )
+	{
+		if( old_functions_[i].named )
+			old_by_name.emplace( old_functions_[i].name, i );
+	}
+
+	for( size_t i = 0; i < new_functions_.size(); i++ )
+	{
+		Function& new_func = new_functions_[i];
+		auto it = new_func.named ? old_by_name.find( new_func.name ) : old_by_name.end();
+		if( it == old_by_name.end() )
+			continue;
+
+		Function& old_func = old_functions_[it->second];
+		old_func.matched = new_func.matched = true;
+		if( old_func.hash == new_func.hash )
+		{
+			num_unchanged_++;
+			continue;
+		}
+
+		changed[i] = { Change::MODIFIED, old_func.name, new_func.name, old_func.start, new_func.start };
+		has_change[i] = true;
+	}
+
+	// Whatever is left can only be matched by its code, ambiguous hashes are left alone
+	std::unordered_map<uint64_t, size_t> old_by_hash;
+	std::unordered_map<uint64_t, size_t> new_count;
+	for( size_t i = 0; i < old_functions_.size(); i++ )
+	{
+		if( old_functions_[i].matched )
+			continue;
+		auto result = old_by_hash.emplace( old_functions_[i].hash, i );
+		if( !result.second )
+			result.first->second = SIZE_MAX;
+	}
+	for( const Function& new_func : new_functions_ )
+	{
+		if( !new_func.matched )
+			new_count[new_func.hash]++;
+	}
+
+	for( size_t i = 0; i < new_functions_.size(); i++ )
+	{
+		Function& new_func = new_functions_[i];
+		if( new_func.matched )
+			continue;
+
+		auto it = old_by_hash.find( new_func.hash );
+		if( it != old_by_hash.end() && it->second != SIZE_MAX && new_count[new_func.hash] == 1 )
+		{
+			Function& old_func = old_functions_[it->second];
+			old_func.matched = new_func.matched = true;
+
+			// Unnamed functions have no name to change, only their address moved
+			if( !old_func.named && !new_func.named )
+			{
+				num_unchanged_++;
+				continue;
+			}
+
+			changed[i] = { Change::RENAMED, old_func.name, new_func.name, old_func.start, new_func.start };
+		}
+		else
+		{
+			new_func.matched = true;
+			changed[i] = { Change::ADDED, "", new_func.name, -1, new_func.start };
+		}
+		has_change[i] = true;
+	}
+
+	for( size_t i = 0; i < new_functions_.size(); i++ )
+	{
+		if( has_change[i] )
+			entries_.push_back( std::move( changed[i] ) );
+	}
+	for( const Function& old_func : old_functions_ )
+	{
+		if( !old_func.matched )
+			entries_.push_back( { Change::REMOVED, old_func.name, "", old_func.start, -1 } );
+	}
+}
+
+void PluginDiff::Print( const DecompilerOptions& options )
+{
+	static const char* change_names[] = { "modified", "renamed", "added", "removed" };
+
+	DecompilerOptions decompile_options = options;
+	decompile_options.print_il = false;
+	decompile_options.print_assembly = false;
+	Decompiler old_decompiler( *old_smx_, decompile_options );
+	Decompiler new_decompiler( *new_smx_, decompile_options );
+
+	auto Decompile = []( Decompiler& decompiler, SmxFile& smx, cell_t start ) -> std::string {
+		SmxFunction* func = FindOrAddFunction( smx, start );
+		return func ? decompiler.Decompile( *func ).code : std::string();
+	};
+
+	size_t counts[4] = {};
+	for( const Entry& entry : entries_ )
+		counts[(int)entry.change]++;
+
+	if( options.format == OutputFormat::NDJSON )
+	{
+		JsonWriter json;
+		json.BeginObject().Key( "unchanged" ).Number( (int64_t)num_unchanged_ );
+		for( int i = 0; i < 4; i++ )
+			json.Key( change_names[i] ).Number( (int64_t)counts[i] );
+		json.EndObject();
+		std::cout << json.str() << '\n';
+	}
+	else
+	{
+		std::cout << "// " << num_unchanged_ << " unchanged";
+		for( int i = 0; i < 4; i++ )
+			std::cout << ", " << counts[i] << ' ' << change_names[i];
+		std::cout << "\n\n";
+	}
+
+	for( const Entry& entry : entries_ )
+	{
+		std::string old_code;
+		std::string new_code;
+		if( entry.change == Change::MODIFIED )
+			old_code = Decompile( old_decompiler, *old_smx_, entry.old_start );
+		if( entry.change == Change::MODIFIED || entry.change == Change::ADDED )
+			new_code = Decompile( new_decompiler, *new_smx_, entry.new_start );
+
+		if( options.format == OutputFormat::NDJSON )
+		{
+			JsonWriter json;
+			json.BeginObject().Key( "change" ).String( change_names[(int)entry.change] );
+			if( entry.old_start != -1 )
+			{
+				json.Key( "old_name" ).String( entry.old_name )
+					.Key( "old_start" ).Number( (int64_t)entry.old_start );
+			}
+			if( entry.new_start != -1 )
+			{
+				json.Key( "name" ).String( entry.new_name )
+					.Key( "start" ).Number( (int64_t)entry.new_start );
+			}
+			if( !old_code.empty() )
+				json.Key( "old_code" ).String( old_code );
+			if( !new_code.empty() )
+				json.Key( "code" ).String( new_code );
+			json.EndObject();
+			std::cout << json.str() << '\n';
+			continue;
+		}
+
+		switch( entry.change )
+		{
+		case Change::MODIFIED:
+			std::cout << "// modified: " << entry.new_name << "\n// --- old\n" << old_code << "// +++ new\n" << new_code << '\n';
+			break;
+		case Change::RENAMED:
+			std::cout << "// renamed: " << entry.old_name << " -> " << entry.new_name << "\n\n";
+			break;
+		case Change::ADDED:
+			std::cout << "// added: " << entry.new_name << '\n' << new_code << '\n';
+			break;
+		case Change::REMOVED:
+			std::cout << "// removed: " << entry.old_name << "\n\n";
+			break;
+		}
+	}
+	std::cout.flush();
+}
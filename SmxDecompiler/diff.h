@@ -0,0 +1,62 @@
+#pragma once
+
+#include "smx-file.h"
+#include "decompiler-options.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Function level differences between two builds of a plugin, found without lifting anything.
+// Functions are matched by name, whatever is left over (unnamed or renamed functions) by code alone.
+// Matched functions are compared by fingerprint (see FingerprintDb) with the names of the functions
+// and globals they use mixed in, so only the functions that really changed have to be decompiled
+class PluginDiff
+{
+public:
+	enum class Change
+	{
+		MODIFIED,
+		RENAMED, // Same code under a different name
+		ADDED,
+		REMOVED
+	};
+
+	struct Entry
+	{
+		Change change;
+		std::string old_name; // Empty for ADDED
+		std::string new_name; // Empty for REMOVED
+		cell_t old_start;     // -1 for ADDED
+		cell_t new_start;     // -1 for REMOVED
+	};
+
+	PluginDiff( SmxFile& old_smx, SmxFile& new_smx );
+
+	size_t num_unchanged() const { return num_unchanged_; }
+	// Changed functions in order of the new file, followed by the removed ones in order of the old file
+	size_t num_entries() const { return entries_.size(); }
+	const Entry& entry( size_t index ) const { return entries_[index]; }
+
+	// Prints a summary and every change to stdout, decompiling both versions of modified functions
+	// and the new version of added ones
+	void Print( const DecompilerOptions& options );
+private:
+	struct Function
+	{
+		cell_t start;
+		std::string name;
+		bool named;
+		uint64_t hash;
+		bool matched = false;
+	};
+
+	static std::vector<Function> CollectFunctions( SmxFile& smx );
+	void Match();
+private:
+	SmxFile* old_smx_;
+	SmxFile* new_smx_;
+	std::vector<Function> old_functions_;
+	std::vector<Function> new_functions_;
+	std::vector<Entry> entries_;
+	size_t num_unchanged_ = 0;
+};
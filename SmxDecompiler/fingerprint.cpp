@@ -0,0 +1,199 @@
+#include "fingerprint.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include "smx-opcodes.h"
+#include "xrefs.h"
+
+static uint64_t HashBytes( uint64_t hash, const void* data, size_t size )
+{
+	// FNV-1a
+	const unsigned char* bytes = static_cast<const unsigned char*>( data );
+	for( size_t i = 0; i < size; i++ )
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static uint64_t HashCell( uint64_t hash, cell_t val )
+{
+	return HashBytes( hash, &val, sizeof( val ) );
+}
+
+uint64_t FingerprintDb::Fingerprint( SmxFile& smx, cell_t start, cell_t end, size_t* num_instructions )
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t count = 0;
+
+	const cell_t* instr = smx.code( start );
+	const cell_t* func_end = smx.code( end );
+	std::vector<const cell_t*> address_operands = XrefIndex::FindAddressOperands( smx, instr, func_end );
+	while( instr < func_end )
+	{
+		// Whatever follows the last function's ENDPROC isn't part of it, nor is code cut off in the
+		// middle of an instruction
+		const cell_t* next = SmxInstrInfo::Next( instr, func_end );
+		if( instr[0] == SMX_OP_ENDPROC || !next )
+			break;
+
+		const auto& info = SmxInstrInfo::Get( instr[0] );
+		hash = HashCell( hash, instr[0] );
+		count++;
+
+		if( instr[0] == SMX_OP_CASETBL )
+		{
+			// Only the case values, not where they jump to
+			hash = HashCell( hash, instr[1] );
+			for( cell_t i = 0; i < instr[1]; i++ )
+				hash = HashCell( hash, instr[3 + i * 2] );
+		}
+		else
+		{
+			for( int param = 1; param <= info.num_params; param++ )
+			{
+				switch( info.params[param - 1] )
+				{
+				case SmxParam::CONSTANT:
+					// Constants used as addresses point into .data, which moves around with everything
+					// else in it. Strings go by their contents, anything else is left out like the other
+					// global addresses. Constants used as numbers are kept as they are
+					if( !std::binary_search( address_operands.begin(), address_operands.end(), instr + param ) )
+						hash = HashCell( hash, instr[param] );
+					else if( smx.IsStringStart( instr[param] ) )
+						hash = HashBytes( hash, smx.data( instr[param] ), smx.StringLength( instr[param] ) );
+					else
+						hash = HashBytes( hash, "address", 7 );
+					break;
+				case SmxParam::STACK:
+					hash = HashCell( hash, instr[param] );
+					break;
+				case SmxParam::NATIVE:
+				{
+					// Native indices depend on which natives the plugin uses, the name doesn't
+					SmxNative* native = smx.FindNativeByIndex( instr[param] );
+					if( native && native->name )
+						hash = HashBytes( hash, native->name, strlen( native->name ) );
+					break;
+				}
+				case SmxParam::JUMP:
+				case SmxParam::FUNCTION:
+				case SmxParam::ADDRESS:
+					break;
+				}
+			}
+		}
+
+		instr = next;
+	}
+
+	if( num_instructions )
+		*num_instructions = count;
+	return hash;
+}
+
+void FingerprintDb::AddFile( SmxFile& smx )
+{
+	XrefIndex xrefs( smx );
+	for( size_t i = 0; i < xrefs.num_functions(); i++ )
+	{
+		cell_t start = xrefs.function( i );
+		cell_t end = i + 1 < xrefs.num_functions() ? xrefs.function( i + 1 ) : (cell_t)smx.code_size();
+
+		SmxFunction* func = smx.FindFunctionAt( start );
+		if( !func || func->pcode_start != start || !func->name )
+			continue;
+
+		size_t num_instructions;
+		uint64_t fingerprint = Fingerprint( smx, start, end, &num_instructions );
+		if( num_instructions >= kMinInstructions )
+			Add( fingerprint, func->name );
+	}
+}
+
+void FingerprintDb::Add( uint64_t fingerprint, const std::string& name )
+{
+	auto it = names_.find( fingerprint );
+	if( it == names_.end() )
+		names_.emplace( fingerprint, name );
+	else if( it->second != name )
+		it->second.clear();
+}
+
+bool FingerprintDb::Load( const char* path )
+{
+	std::ifstream file( path );
+	if( !file )
+		return false;
+
+	std::string line;
+	while( std::getline( file, line ) )
+	{
+		unsigned long long fingerprint;
+		int name_start = 0;
+		if( sscanf( line.c_str(), "%16llx %n", &fingerprint, &name_start ) < 1 )
+			continue;
+
+		// A line without a name is an ambiguous fingerprint
+		std::string name = name_start ? line.substr( name_start ) : "";
+		if( name.empty() )
+			names_[fingerprint].clear();
+		else
+			Add( fingerprint, name );
+	}
+	return true;
+}
+
+bool FingerprintDb::Save( const char* path ) const
+{
+	std::vector<std::pair<uint64_t, const std::string*>> entries;
+	entries.reserve( names_.size() );
+	for( const auto& entry : names_ )
+		entries.emplace_back( entry.first, &entry.second );
+	std::sort( entries.begin(), entries.end() );
+
+	std::ofstream file( path );
+	for( const auto& entry : entries )
+	{
+		char fingerprint[17];
+		snprintf( fingerprint, sizeof( fingerprint ), "%016llx", (unsigned long long)entry.first );
+		file << fingerprint;
+		if( !entry.second->empty() )
+			file << ' ' << *entry.second;
+		file << '\n';
+	}
+	return file.good();
+}
+
+const char* FingerprintDb::Find( uint64_t fingerprint ) const
+{
+	auto it = names_.find( fingerprint );
+	if( it == names_.end() || it->second.empty() )
+		return nullptr;
+	return it->second.c_str();
+}
+
+std::unordered_map<cell_t, const char*> FingerprintDb::Match( SmxFile& smx ) const
+{
+	std::unordered_map<cell_t, const char*> matches;
+
+	XrefIndex xrefs( smx );
+	for( size_t i = 0; i < xrefs.num_functions(); i++ )
+	{
+		cell_t start = xrefs.function( i );
+		cell_t end = i + 1 < xrefs.num_functions() ? xrefs.function( i + 1 ) : (cell_t)smx.code_size();
+
+		size_t num_instructions;
+		uint64_t fingerprint = Fingerprint( smx, start, end, &num_instructions );
+		if( num_instructions < kMinInstructions )
+			continue;
+
+		if( const char* name = Find( fingerprint ) )
+			matches.emplace( start, name );
+	}
+	return matches;
+}
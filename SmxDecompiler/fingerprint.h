@@ -0,0 +1,38 @@
+#pragma once
+
+#include "smx-file.h"
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+// Fingerprints of functions, for recognizing library code (stocks from SourceMod and common includes)
+// that gets compiled into many plugins. A fingerprint covers the function's pcode with everything that
+// depends on where things ended up in the plugin masked out: jump and call targets and global
+// addresses aren't included (constants used as an address only count as being one), natives are
+// included by name and constants used as the address of a string by the string they point at.
+class FingerprintDb
+{
+public:
+	// Shorter functions are too generic (getters, stubs) to be told apart reliably
+	static constexpr size_t kMinInstructions = 8;
+
+	static uint64_t Fingerprint( SmxFile& smx, cell_t start, cell_t end, size_t* num_instructions = nullptr );
+
+	// Adds every named function of the file that is long enough
+	void AddFile( SmxFile& smx );
+
+	// One "<fingerprint> <name>" line per function, fingerprints shared by differently named
+	// functions are kept without a name so they stay unrecognized
+	bool Load( const char* path );
+	bool Save( const char* path ) const;
+
+	size_t size() const { return names_.size(); }
+	// Name of the known function with the fingerprint, or nullptr if there is none or it is ambiguous
+	const char* Find( uint64_t fingerprint ) const;
+	// Known name of every function in the file that is recognized, keyed by function start
+	std::unordered_map<cell_t, const char*> Match( SmxFile& smx ) const;
+private:
+	void Add( uint64_t fingerprint, const std::string& name );
+private:
+	std::unordered_map<uint64_t, std::string> names_; // Empty for ambiguous fingerprints
+};
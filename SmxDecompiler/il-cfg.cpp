@@ -1,57 +1,55 @@
 #include "il-cfg.h"
 
 #include "il.h"
+#include "trace.h"
 #include <cassert>
+#include <algorithm>
 
 void ILControlFlowGraph::AddBlock( size_t id, cell_t pc )
 {
-	blocks_.emplace_back( *this, pc );
-	blocks_.back().id_ = id;
-
-	stable_blocks_.clear();
-	for( ILBlock& bb : blocks_ )
-		stable_blocks_.emplace_back( &bb );
+	// Blocks live in a deque so appending never moves the ones already handed out
+	ILBlock& bb = blocks_.emplace_back( *this, pc );
+	DecompileBudget::Allocated( sizeof( ILBlock ) );
+	bb.id_ = id;
+	stable_blocks_.push_back( &bb );
+	blocks_by_pc_.emplace( pc, &bb );
 }
 
 ILBlock* ILControlFlowGraph::FindBlockAt( cell_t pc )
 {
-	for( ILBlock* bb : stable_blocks_ )
-	{
-		if( bb->pc() == pc )
-		{
-			return bb;
-		}
-	}
-	return nullptr;
+	auto it = blocks_by_pc_.find( pc );
+	return it != blocks_by_pc_.end() ? it->second : nullptr;
 }
 
 void ILControlFlowGraph::Remove( ILBlock& bb )
 {
-	auto it = std::find( stable_blocks_.begin(), stable_blocks_.end(), &bb );
-	if( it != stable_blocks_.end() )
-	{
-		stable_blocks_.erase( it );
-		for( size_t i = 0; i < stable_blocks_.size(); i++ )
-		{
-			stable_blocks_[i]->id_ = i;
-		}
-	}
-
-	Verify();
+	// Only mark the block as dead here, dropping it from the block list and renumbering
+	// is deferred to Compact so a run of removals costs a single pass
+	if( bb.removed_ )
+		return;
+
+	bb.removed_ = true;
+	num_removed_++;
+	ForgetBlockPc( bb );
 }
 
 void ILControlFlowGraph::RemoveMultiple( ILBlock** blocks, size_t num_blocks )
 {
-	Verify();
-
 	for( size_t block = 0; block < num_blocks; block++ )
 	{
-		auto it = std::find( stable_blocks_.begin(), stable_blocks_.end(), blocks[block] );
-		if( it != stable_blocks_.end() )
-		{
-			stable_blocks_.erase( it );
-		}
+		Remove( *blocks[block] );
 	}
+}
+
+void ILControlFlowGraph::Compact()
+{
+	if( !num_removed_ )
+		return;
+
+	stable_blocks_.erase(
+		std::remove_if( stable_blocks_.begin(), stable_blocks_.end(), []( ILBlock* bb ) { return bb->removed_; } ),
+		stable_blocks_.end() );
+	num_removed_ = 0;
 
 	for( size_t i = 0; i < stable_blocks_.size(); i++ )
 	{
@@ -61,94 +59,127 @@ void ILControlFlowGraph::RemoveMultiple( ILBlock** blocks, size_t num_blocks )
 	Verify();
 }
 
-void ILControlFlowGraph::ComputeDominance()
+void ILControlFlowGraph::ForgetBlockPc( ILBlock& bb )
 {
-	for( ILBlock* b : stable_blocks_ )
+	auto it = blocks_by_pc_.find( bb.pc() );
+	if( it != blocks_by_pc_.end() && it->second == &bb )
+		blocks_by_pc_.erase( it );
+}
+
+void ILControlFlowGraph::BuildEdges()
+{
+	edges_.Clear();
+	for( ILBlock* bb : stable_blocks_ )
 	{
-		b->SetImmediateDominator( nullptr );
-		b->SetImmediatePostDominator( nullptr );
+		for( ILBlock* in : bb->in_edges_ )
+			edges_.AddIn( in->id() );
+		for( ILBlock* out : bb->out_edges_ )
+			edges_.AddOut( out->id() );
+		edges_.EndBlock();
 	}
+}
+
+void ILControlFlowGraph::ComputeDominance()
+{
+	TraceSpan span( "ComputeDominance" );
+	Compact();
+	BuildEdges();
+
+	// Dominators are worked out on block ids over the edge arrays, then stored on the blocks at the end
+	const size_t n = num_blocks();
+	std::vector<size_t> idom( n, kNoBlock );
+	std::vector<size_t> post_idom( n, kNoBlock );
 
 	// Compute immediate dominators
-	block( 0 ).SetImmediateDominator( &block( 0 ) );
+	idom[0] = 0;
 
 	bool changed = true;
 	while( changed )
 	{
 		changed = false;
-		for( size_t i = 1; i < num_blocks(); i++ )
+		for( size_t b = 1; b < n; b++ )
 		{
-			ILBlock& b = block( i );
-			assert( b.num_in_edges() );
+			DecompileBudget::Check();
+			assert( edges_.num_in_edges( b ) );
 
-			ILBlock* new_idom = &b.in_edge( 0 );
-			for( size_t in = 1; in < b.num_in_edges(); in++ )
+			size_t new_idom = edges_.in_edge( b, 0 );
+			for( size_t in = 1; in < edges_.num_in_edges( b ); in++ )
 			{
-				ILBlock& p = b.in_edge( in );
-				if( p.immed_dominator() != nullptr )
+				size_t p = edges_.in_edge( b, in );
+				if( idom[p] != kNoBlock )
 				{
-					new_idom = Intersect( p, *new_idom );
+					new_idom = Intersect( idom, p, new_idom );
 				}
 			}
 
-			if( b.immed_dominator() != new_idom )
+			if( idom[b] != new_idom )
 			{
-				b.SetImmediateDominator( new_idom );
+				idom[b] = new_idom;
 				changed = true;
 			}
 		}
 	}
 
 	// Compute immediate post-dominators
-	int last = (int)num_blocks() - 1;
-	block( last ).SetImmediatePostDominator( &block( last ) );
+	int last = (int)n - 1;
+	post_idom[last] = last;
 
 	changed = true;
 	while( changed )
 	{
 		changed = false;
-		for( int i = last - 1; i >= 0; i-- )
+		for( int b = last - 1; b >= 0; b-- )
 		{
-			ILBlock& b = block( i );
-			if( !b.num_out_edges() )
+			DecompileBudget::Check();
+			size_t num_out = edges_.num_out_edges( b );
+			if( !num_out )
 			{
-				b.SetImmediatePostDominator( &b );
+				post_idom[b] = b;
 				continue;
 			}
 
-			ILBlock* new_idom = &b.out_edge( b.num_out_edges() - 1 );
-			for( int out = (int)b.num_out_edges() - 2; out >= 0; out-- )
+			size_t new_idom = edges_.out_edge( b, num_out - 1 );
+			for( int out = (int)num_out - 2; out >= 0; out-- )
 			{
-				ILBlock& p = b.out_edge( out );
-				if( p.immed_post_dominator() != nullptr )
+				size_t p = edges_.out_edge( b, out );
+				if( post_idom[p] != kNoBlock )
 				{
-					new_idom = IntersectPost( p, *new_idom );
-					if( !new_idom )
+					new_idom = IntersectPost( post_idom, p, new_idom );
+					if( new_idom == kNoBlock )
 						break;
 				}
 			}
 
-			if( new_idom == nullptr )
-				new_idom = &b;
+			if( new_idom == kNoBlock )
+				new_idom = b;
 
-			if( b.immed_post_dominator() != new_idom )
+			if( post_idom[b] != new_idom )
 			{
-				b.SetImmediatePostDominator( new_idom );
+				post_idom[b] = new_idom;
 				changed = true;
 			}
 		}
 	}
 
+	for( size_t b = 0; b < n; b++ )
+	{
+		block( b ).SetImmediateDominator( idom[b] != kNoBlock ? &block( idom[b] ) : nullptr );
+		block( b ).SetImmediatePostDominator( post_idom[b] != kNoBlock ? &block( post_idom[b] ) : nullptr );
+	}
+
 	Verify();
 }
 
 ILControlFlowGraph* ILControlFlowGraph::Next()
 {
-	std::vector<std::vector<ILBlock*>> intervals;
-
+	Compact();
+	BuildEdges();
 	NewEpoch();
 
-	intervals.push_back( IntervalForHeader( block( 0 ) ) );
+	std::vector<std::vector<ILBlock*>> intervals;
+	std::vector<size_t> interval_of( num_blocks(), kNoBlock );
+
+	intervals.push_back( IntervalForHeader( block( 0 ), 0, interval_of ) );
 
 	bool changed = true;
 	while( changed )
@@ -157,18 +188,19 @@ ILControlFlowGraph* ILControlFlowGraph::Next()
 
 		for( size_t i = 1; i < num_blocks(); i++ )
 		{
+			DecompileBudget::Check();
 			ILBlock& m = block( i );
 			if( m.IsVisited() )
 			{
 				continue;
 			}
 
-			for( size_t i = 0; i < m.num_in_edges(); i++ )
+			for( size_t in = 0; in < edges_.num_in_edges( i ); in++ )
 			{
-				ILBlock& p = m.in_edge( i );
+				ILBlock& p = block( edges_.in_edge( i, in ) );
 				if( p.IsVisited() )
 				{
-					intervals.push_back( IntervalForHeader( m ) );
+					intervals.push_back( IntervalForHeader( m, intervals.size(), interval_of ) );
 					changed = true;
 					break;
 				}
@@ -195,13 +227,11 @@ ILControlFlowGraph* ILControlFlowGraph::Next()
 		ILBlock* outer = &next->block( i );
 		for( size_t j = 0; j < intervals[i].size(); j++ )
 		{
-			ILBlock* inner = intervals[i][j];
-			for( size_t edge = 0; edge < inner->num_out_edges(); edge++ )
+			size_t inner = intervals[i][j]->id();
+			for( size_t edge = 0; edge < edges_.num_out_edges( inner ); edge++ )
 			{
-				ILBlock* target = &inner->out_edge( edge );
-
 				// Find the outer interval that corresponds to this edge
-				size_t outer_target_index = FindOuterTarget( intervals, target );
+				size_t outer_target_index = interval_of[edges_.out_edge( inner, edge )];
 				ILBlock* outer_target = &next->block( outer_target_index );
 				if( outer_target != outer )
 				{
@@ -214,54 +244,55 @@ ILControlFlowGraph* ILControlFlowGraph::Next()
 	return next;
 }
 
-ILBlock* ILControlFlowGraph::Intersect( ILBlock& b1, ILBlock& b2 )
+size_t ILControlFlowGraph::Intersect( const std::vector<size_t>& idom, size_t b1, size_t b2 )
 {
-	ILBlock* finger1 = &b1;
-	ILBlock* finger2 = &b2;
+	size_t finger1 = b1;
+	size_t finger2 = b2;
 	while( finger1 != finger2 )
 	{
-		while( finger1->id() > finger2->id() )
+		while( finger1 > finger2 )
 		{
-			finger1 = finger1->immed_dominator();
+			finger1 = idom[finger1];
 		}
-		while( finger2->id() > finger1->id() )
+		while( finger2 > finger1 )
 		{
-			finger2 = finger2->immed_dominator();
+			finger2 = idom[finger2];
 		}
 	}
 	return finger1;
 }
 
-ILBlock* ILControlFlowGraph::IntersectPost( ILBlock& b1, ILBlock& b2 )
+size_t ILControlFlowGraph::IntersectPost( const std::vector<size_t>& post_idom, size_t b1, size_t b2 )
 {
-	ILBlock* finger1 = &b1;
-	ILBlock* finger2 = &b2;
+	size_t finger1 = b1;
+	size_t finger2 = b2;
 	while( finger1 != finger2 )
 	{
-		while( finger1->id() < finger2->id() )
+		while( finger1 < finger2 )
 		{
-			if( finger1 == finger1->immed_post_dominator() )
-				return nullptr;
-			finger1 = finger1->immed_post_dominator();
-			if( !finger1 )
+			if( finger1 == post_idom[finger1] )
+				return kNoBlock;
+			finger1 = post_idom[finger1];
+			if( finger1 == kNoBlock )
 				return finger2;
 		}
-		while( finger2->id() < finger1->id() )
+		while( finger2 < finger1 )
 		{
-			if( finger2 == finger2->immed_post_dominator() )
-				return nullptr;
-			finger2 = finger2->immed_post_dominator();
-			if( !finger2 )
+			if( finger2 == post_idom[finger2] )
+				return kNoBlock;
+			finger2 = post_idom[finger2];
+			if( finger2 == kNoBlock )
 				return finger1;
 		}
 	}
 	return finger1;
 }
 
-std::vector<ILBlock*> ILControlFlowGraph::IntervalForHeader( ILBlock& header )
+std::vector<ILBlock*> ILControlFlowGraph::IntervalForHeader( ILBlock& header, size_t index, std::vector<size_t>& interval_of )
 {
 	std::vector<ILBlock*> I;
 	I.push_back( &header );
+	interval_of[header.id()] = index;
 	header.SetVisited();
 	for( size_t i = 1; i < num_blocks(); i++ )
 	{
@@ -272,10 +303,9 @@ std::vector<ILBlock*> ILControlFlowGraph::IntervalForHeader( ILBlock& header )
 		}
 
 		bool add_to_interval = true;
-		for( size_t j = 0; j < m.num_in_edges(); j++ )
+		for( size_t j = 0; j < edges_.num_in_edges( i ); j++ )
 		{
-			ILBlock* p = &m.in_edge( j );
-			if( std::find( I.begin(), I.end(), p ) == I.end() )
+			if( interval_of[edges_.in_edge( i, j )] != index )
 			{
 				add_to_interval = false;
 				break;
@@ -285,6 +315,7 @@ std::vector<ILBlock*> ILControlFlowGraph::IntervalForHeader( ILBlock& header )
 		if( add_to_interval )
 		{
 			I.push_back( &m );
+			interval_of[i] = index;
 			m.SetVisited();
 		}
 	}
@@ -292,17 +323,6 @@ std::vector<ILBlock*> ILControlFlowGraph::IntervalForHeader( ILBlock& header )
 	return I;
 }
 
-size_t ILControlFlowGraph::FindOuterTarget( const std::vector<std::vector<ILBlock*>> intervals, ILBlock* target )
-{
-	for( size_t i = 0; i < intervals.size(); i++ )
-	{
-		if( std::find( intervals[i].begin(), intervals[i].end(), target ) != intervals[i].end() )
-			return i;
-	}
-
-	return (size_t)-1;
-}
-
 void ILControlFlowGraph::Verify()
 {
 #ifdef _DEBUG
@@ -327,13 +347,46 @@ void ILControlFlowGraph::NewEpoch()
 	epoch_++;
 }
 
+void ILBlock::InsertBefore( ILNode* pos, ILNode* node )
+{
+	assert( !node->parent_ );
+	assert( !pos || pos->parent_ == this );
+
+	// Inserting before nullptr appends
+	ILNode* prev = pos ? pos->prev_ : last_;
+	node->parent_ = this;
+	node->prev_ = prev;
+	node->next_ = pos;
+	(prev ? prev->next_ : first_) = node;
+	(pos ? pos->prev_ : last_) = node;
+	num_nodes_++;
+}
+
+void ILBlock::InsertAfter( ILNode* pos, ILNode* node )
+{
+	assert( pos && pos->parent_ == this );
+	InsertBefore( pos->next_, node );
+}
+
 void ILBlock::Remove( ILNode* node )
 {
-	auto it = std::find( nodes_.begin(), nodes_.end(), node );
-	if( it != nodes_.end() )
-	{
-		nodes_.erase( it );
-	}
+	if( node->parent_ != this )
+		return;
+
+	(node->prev_ ? node->prev_->next_ : first_) = node->next_;
+	(node->next_ ? node->next_->prev_ : last_) = node->prev_;
+	node->parent_ = nullptr;
+	node->prev_ = nullptr;
+	node->next_ = nullptr;
+	num_nodes_--;
+}
+
+void ILBlock::Replace( ILNode* node, ILNode* value )
+{
+	assert( node->parent_ == this );
+	ILNode* next = node->next_;
+	Remove( node );
+	InsertBefore( next, value );
 }
 
 void ILBlock::ReplaceOutEdge( ILBlock& from_block, ILBlock& to_block )
@@ -395,19 +448,19 @@ void ILBlock::AddInEdge( ILBlock& block )
 
 void ILBlock::AddToStart( ILNode* node )
 {
-	nodes_.insert( nodes_.begin(), node );
+	InsertBefore( first_, node );
 }
 
 void ILBlock::AddToEnd( ILNode* node )
 {
-	if( !nodes_.empty() &&
-		(dynamic_cast<ILJump*>(nodes_.back()) || dynamic_cast<ILJumpCond*>(nodes_.back()) || dynamic_cast<ILReturn*>(nodes_.back())) )
+	if( last_ &&
+		(dynamic_cast<ILJump*>(last_) || dynamic_cast<ILJumpCond*>(last_) || dynamic_cast<ILReturn*>(last_)) )
 	{
-		nodes_.insert( nodes_.end() - 1, node );
+		InsertBefore( last_, node );
 	}
 	else
 	{
-		nodes_.push_back( node );
+		InsertBefore( nullptr, node );
 	}
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "cfg.h"
+#include <deque>
+#include <unordered_map>
 
 class ILControlFlowGraph;
 class ILNode;
@@ -14,11 +16,13 @@ public:
 		pc_( pc )
 	{}
 
-	void Add( ILNode* node ) { nodes_.push_back( node ); }
-	void Insert( size_t index, ILNode* node ) { nodes_.insert( nodes_.begin() + index, node ); }
+	// Nodes are kept in an intrusive list, so inserting/removing/replacing never moves other nodes
+	// and a node pointer stays valid as a position while the list around it is edited
+	void Add( ILNode* node ) { InsertBefore( nullptr, node ); }
+	void InsertBefore( ILNode* pos, ILNode* node );
+	void InsertAfter( ILNode* pos, ILNode* node );
 	void Remove( ILNode* node );
-	void Remove( size_t index ) { nodes_.erase( nodes_.begin() + index ); }
-	void Replace( size_t index, ILNode* value ) { nodes_[index] = value; }
+	void Replace( ILNode* node, ILNode* value );
 	void ReplaceOutEdge( ILBlock& from_block, ILBlock& to_block );
 	void ReplaceInEdge( ILBlock& from_block, ILBlock& to_block );
 	void RemoveOutEdge( ILBlock& block );
@@ -28,12 +32,12 @@ public:
 	void AddToStart( ILNode* node );
 	void AddToEnd( ILNode* node );
 	void AddTarget( ILBlock& bb );
-	ILNode* Last() { return nodes_.empty() ? nullptr : nodes_.back(); }
+	ILNode* First() const { return first_; }
+	ILNode* Last() const { return last_; }
 
 	cell_t pc() const { return pc_; }
 	size_t id() const { return id_; }
-	size_t num_nodes() const { return nodes_.size(); }
-	ILNode* node( size_t index ) const { return nodes_[index]; }
+	size_t num_nodes() const { return num_nodes_; }
 	size_t num_in_edges() const { return in_edges_.size(); }
 	ILBlock& in_edge( size_t index ) const { return *in_edges_[index]; }
 	size_t num_out_edges() const { return out_edges_.size(); }
@@ -52,6 +56,9 @@ public:
 
 	bool IsVisited() const;
 	void SetVisited();
+
+	// Set once the block is removed from its graph, it stays in the block list until the next Compact
+	bool IsRemoved() const { return removed_; }
 private:
 	friend class ILControlFlowGraph;
 
@@ -59,7 +66,12 @@ private:
 	cell_t pc_;
 	size_t id_ = 0;
 	int epoch_ = 0;
-	std::vector<ILNode*> nodes_;
+	bool removed_ = false;
+	ILNode* first_ = nullptr;
+	ILNode* last_ = nullptr;
+	size_t num_nodes_ = 0;
+	// The passes that edit the graph work on these, ILControlFlowGraph::edges() is a copy in CSR form
+	// for the passes that only read it
 	std::vector<ILBlock*> in_edges_;
 	std::vector<ILBlock*> out_edges_;
 	ILBlock* idom_ = nullptr;
@@ -74,8 +86,11 @@ public:
 	ILBlock& Entry() { return blocks_[0]; }
 	void Remove( ILBlock& bb );
 	void RemoveMultiple( ILBlock** blocks, size_t num_blocks );
+	// Drops removed blocks and renumbers the rest, done automatically by ComputeDominance and Next
+	void Compact();
 
 	size_t max_id() const { return blocks_.empty() ? 0 : (blocks_.size() - 1); }
+	// Includes removed blocks until the graph is compacted
 	size_t num_blocks() const { return stable_blocks_.size(); }
 	const ILBlock& block( size_t index ) const { return *stable_blocks_[index]; }
 	ILBlock& block( size_t index ) { return *stable_blocks_[index]; }
@@ -89,15 +104,24 @@ public:
 	void ComputeDominance();
 	void Verify();
 
+	// Snapshot of the edges as of the last ComputeDominance or Next
+	const BlockEdges& edges() const { return edges_; }
+
 	ILControlFlowGraph* Next();
 private:
-	ILBlock* Intersect( ILBlock& b1, ILBlock& b2 );
-	ILBlock* IntersectPost( ILBlock& b1, ILBlock& b2 );
-	std::vector<ILBlock*> IntervalForHeader( ILBlock& header );
-	size_t FindOuterTarget( const std::vector<std::vector<ILBlock*>> intervals, ILBlock* target );
+	static constexpr size_t kNoBlock = (size_t)-1;
+
+	void BuildEdges();
+	static size_t Intersect( const std::vector<size_t>& idom, size_t b1, size_t b2 );
+	static size_t IntersectPost( const std::vector<size_t>& post_idom, size_t b1, size_t b2 );
+	std::vector<ILBlock*> IntervalForHeader( ILBlock& header, size_t index, std::vector<size_t>& interval_of );
+	void ForgetBlockPc( ILBlock& bb );
 private:
 	int nargs_ = 0;
-	std::vector<ILBlock> blocks_;
+	std::deque<ILBlock> blocks_;
 	std::vector<ILBlock*> stable_blocks_;
+	std::unordered_map<cell_t, ILBlock*> blocks_by_pc_;
+	size_t num_removed_ = 0;
+	BlockEdges edges_;
 	int epoch_ = 0;
 };
\ No newline at end of file
@@ -18,9 +18,9 @@ std::string ILDisassembler::DisassembleBlock( const ILBlock& block )
 	func_ = smx_->FindFunctionAt( block.pc() );
 
 	std::stringstream block_disasm;
-	for( size_t node = 0; node < block.num_nodes(); node++ )
+	for( ILNode* node = block.First(); node; node = node->next() )
 	{
-		block_disasm << DisassembleNode( block.node( node ) ) << '\n';
+		block_disasm << DisassembleNode( node ) << '\n';
 	}
 	return block_disasm.str();
 }
@@ -137,11 +137,11 @@ void ILDisassembler::VisitLocalVar( ILLocalVar* node )
 	bool found_name = false;
 	if( func_ )
 	{
-		for( size_t i = 0; i < func_->num_locals; i++ )
+		for( size_t i = 0; i < func_->num_locals(); i++ )
 		{
-			if( func_->locals[i].address == node->stack_offset() )
+			if( func_->local( i ).address == node->stack_offset() )
 			{
-				disasm_ << func_->locals[i].name;
+				disasm_ << func_->local( i ).name;
 				found_name = true;
 				break;
 			}
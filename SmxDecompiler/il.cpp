@@ -1,6 +1,6 @@
 #include "il.h"
 
-class Inverter : public ILVisitor
+class Inverter : public StaticILVisitor<Inverter>
 {
 public:
 	ILNode* Invert( ILNode* node )
@@ -8,7 +8,7 @@ public:
 		ILNode* save = nullptr;
 		std::swap( save, result_ );
 
-		node->Accept( this );
+		Visit( node );
 		if( !result_ )
 			result_ = new ILUnary( node, ILUnary::NOT );
 
@@ -16,7 +16,7 @@ public:
 		return save;
 	}
 
-	virtual void VisitBinary( ILBinary* binary ) override
+	void VisitBinary( ILBinary* binary )
 	{
 		switch( binary->op() )
 		{
@@ -46,7 +46,7 @@ public:
 				return;
 		}
 	}
-	virtual void VisitUnary( ILUnary* unary ) override
+	void VisitUnary( ILUnary* unary )
 	{
 		switch( unary->op() )
 		{
@@ -64,5 +64,5 @@ void ILJumpCond::Invert()
 	std::swap( true_branch_, false_branch_ );
 
 	Inverter inv;
-	condition_ = inv.Invert( condition_ );
+	condition_.Set( inv.Invert( condition_.get() ) );
 }
\ No newline at end of file
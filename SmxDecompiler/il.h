@@ -2,10 +2,12 @@
 
 #include "il-cfg.h"
 #include "smx-file.h"
+#include "budget.h"
 
 #include <vector>
 #include <string>
 #include <cassert>
+#include <cstdint>
 
 class ILBlock;
 class ILConst;
@@ -28,6 +30,30 @@ class ILReturn;
 class ILPhi;
 class ILInterval;
 
+// Concrete type of a node, for dispatching on it without going through virtual calls
+enum class ILNodeKind : uint8_t
+{
+	CONST,
+	UNARY,
+	BINARY,
+	LOCAL_VAR,
+	GLOBAL_VAR,
+	HEAP_VAR,
+	ARRAY_ELEMENT_VAR,
+	FIELD_VAR,
+	TEMP_VAR,
+	LOAD,
+	STORE,
+	JUMP,
+	JUMP_COND,
+	SWITCH,
+	CALL,
+	NATIVE,
+	RETURN,
+	PHI,
+	INTERVAL
+};
+
 class ILVisitor
 {
 public:
@@ -54,27 +80,63 @@ public:
 	virtual void VisitInterval( ILInterval* node ) {}
 };
 
+class ILNode;
+
+// Operand slot of a node. Each slot is linked into the use-list of the node it currently refers to,
+// so adding, removing and replacing uses is O(1) and doesn't need any allocations
+class ILUse
+{
+public:
+	ILUse( ILNode* user, ILNode* value = nullptr ) : user_( user ) { Set( value ); }
+	ILUse( ILUse&& other ) noexcept;
+	ILUse( const ILUse& ) = delete;
+	ILUse& operator=( const ILUse& ) = delete;
+	~ILUse() { Unlink(); }
+
+	ILNode* get() const { return value_; }
+	ILNode* user() const { return user_; }
+	// Next use of the same value
+	ILUse* next() const { return next_; }
+
+	void Set( ILNode* value );
+private:
+	friend class ILNode;
+
+	void Link();
+	void Unlink();
+private:
+	ILNode* value_ = nullptr;
+	ILNode* user_;
+	ILUse* prev_ = nullptr;
+	ILUse* next_ = nullptr;
+	bool linked_ = false;
+};
+
 class ILNode
 {
 public:
+	explicit ILNode( ILNodeKind kind ) : kind_( kind ) {}
 	virtual ~ILNode() = default;
 
-	void AddUse( ILNode* user ) { uses_.push_back( user ); }
+	// Nodes count towards the memory limit of the thread's decompile budget
+	static void* operator new( size_t size ) { DecompileBudget::Allocated( size ); return ::operator new( size ); }
+	static void operator delete( void* ptr ) { ::operator delete( ptr ); }
+
+	ILNodeKind kind() const { return kind_; }
+
 	void ReplaceUsesWith( ILNode* replacement )
 	{
-		for( ILNode* use : uses_ )
-			use->ReplaceParam( this, replacement );
-		uses_.clear();
-	}
-	size_t num_uses() const { return uses_.size(); }
-	ILNode* use( size_t index ) { return uses_[index]; }
-	void RemoveUse( size_t index ) { uses_.erase( uses_.begin() + index ); }
-	void RemoveUse( ILNode* user )
-	{
-		auto it = std::find( uses_.begin(), uses_.end(), user );
-		if( it != uses_.end() )
-			uses_.erase( it );
+		for( ILUse* use = first_use_; use; )
+		{
+			ILUse* next = use->next_;
+			use->Set( replacement );
+			use = next;
+		}
 	}
+	size_t num_uses() const { return num_uses_; }
+	ILUse* first_use() const { return first_use_; }
+	// Stops tracking the use without changing what it refers to, only for users that are about to be dropped
+	void RemoveUse( ILUse* use ) { assert( use->value_ == this ); use->Unlink(); }
 	
 	const SmxVariableType* type() const { return type_; }
 	void SetType( const SmxVariableType* type ) { type_ = type; }
@@ -82,16 +144,81 @@ public:
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) {}
 
 	virtual void Accept( ILVisitor* visitor ) = 0;
+
+	// Position in the owning block's node list, nullptr if the node isn't placed in a block
+	ILBlock* parent() const { return parent_; }
+	ILNode* prev() const { return prev_; }
+	ILNode* next() const { return next_; }
 private:
-	std::vector<ILNode*> uses_;
+	friend class ILUse;
+	friend class ILBlock;
+
+	ILBlock* parent_ = nullptr;
+	ILNode* prev_ = nullptr;
+	ILNode* next_ = nullptr;
+	ILNodeKind kind_;
+	ILUse* first_use_ = nullptr;
+	ILUse* last_use_ = nullptr;
+	size_t num_uses_ = 0;
 	const SmxVariableType* type_ = nullptr;
 };
 
+inline ILUse::ILUse( ILUse&& other ) noexcept :
+	value_( other.value_ ),
+	user_( other.user_ ),
+	prev_( other.prev_ ),
+	next_( other.next_ ),
+	linked_( other.linked_ )
+{
+	// Take over the other slot's position in the use-list
+	if( linked_ )
+	{
+		(prev_ ? prev_->next_ : value_->first_use_) = this;
+		(next_ ? next_->prev_ : value_->last_use_) = this;
+	}
+	other.linked_ = false;
+	other.value_ = nullptr;
+}
+
+inline void ILUse::Set( ILNode* value )
+{
+	Unlink();
+	value_ = value;
+	Link();
+}
+
+inline void ILUse::Link()
+{
+	if( !value_ )
+		return;
+
+	// Uses are kept in the order they were added
+	prev_ = value_->last_use_;
+	next_ = nullptr;
+	(prev_ ? prev_->next_ : value_->first_use_) = this;
+	value_->last_use_ = this;
+	value_->num_uses_++;
+	linked_ = true;
+}
+
+inline void ILUse::Unlink()
+{
+	if( !linked_ )
+		return;
+
+	(prev_ ? prev_->next_ : value_->first_use_) = next_;
+	(next_ ? next_->prev_ : value_->last_use_) = prev_;
+	value_->num_uses_--;
+	prev_ = next_ = nullptr;
+	linked_ = false;
+}
+
 class ILConst : public ILNode
 {
 public:
 	ILConst( cell_t val )
 		:
+		ILNode( ILNodeKind::CONST ),
 		val_( val )
 	{}
 
@@ -136,25 +263,23 @@ public:
 
 	ILUnary( ILNode* val, UnaryOp op )
 		:
-		val_( val ),
+		ILNode( ILNodeKind::UNARY ),
+		val_( this, val ),
 		op_( op )
-	{
-		val->AddUse( this );
-	}
+	{}
 
-	ILNode* val() { return val_; }
+	ILNode* val() { return val_.get(); }
 	UnaryOp op() { return op_; }
 
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) override
 	{
-		assert( val_ == target );
-		replacement->AddUse( this );
-		val_ = replacement;
+		assert( val_.get() == target );
+		val_.Set( replacement );
 	}
 
 	virtual void Accept( ILVisitor* visitor ) { visitor->VisitUnary( this ); }
 private:
-	ILNode* val_;
+	ILUse val_;
 	UnaryOp op_;
 };
 
@@ -200,42 +325,41 @@ public:
 
 	ILBinary( ILNode* left, BinaryOp op, ILNode* right )
 		:
-		left_( left ),
+		ILNode( ILNodeKind::BINARY ),
 		op_( op ),
-		right_( right )
-	{
-		left->AddUse( this );
-		right->AddUse( this );
-	}
+		left_( this, left ),
+		right_( this, right )
+	{}
 
 	BinaryOp op() const { return op_; }
-	ILNode* left() const { return left_; }
-	ILNode* right() const { return right_; }
+	ILNode* left() const { return left_.get(); }
+	ILNode* right() const { return right_.get(); }
 
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) override
 	{
-		assert( left_ == target || right_ == target );
-		replacement->AddUse( this );
-		if( left_ == target )
+		assert( left_.get() == target || right_.get() == target );
+		if( left_.get() == target )
 		{
-			left_ = replacement;
+			left_.Set( replacement );
 		}
 		else
 		{
-			right_ = replacement;
+			right_.Set( replacement );
 		}
 	}
 
 	virtual void Accept( ILVisitor* visitor ) { visitor->VisitBinary( this ); }
 private:
 	BinaryOp op_;
-	ILNode* left_;
-	ILNode* right_;
+	ILUse left_;
+	ILUse right_;
 };
 
 class ILVar : public ILNode
 {
 public:
+	explicit ILVar( ILNodeKind kind ) : ILNode( kind ) {}
+
 	SmxVariable* smx_var() const { return var_; }
 	void SetSmxVar( SmxVariable* var ) { var_ = var; }
 private:
@@ -247,31 +371,25 @@ class ILLocalVar : public ILVar
 public:
 	ILLocalVar( int stack_offset, ILNode* value )
 		:
+		ILVar( ILNodeKind::LOCAL_VAR ),
 		stack_offset_( stack_offset ),
-		value_( value )
-	{
-		if( value )
-			value->AddUse( this );
-	}
+		value_( this, value )
+	{}
 
-	void SetValue( ILNode* val ) { value_ = val; value_->AddUse( this ); }
-	ILNode* value() const { return value_; }
+	void SetValue( ILNode* val ) { value_.Set( val ); }
+	ILNode* value() const { return value_.get(); }
 	int stack_offset() const { return stack_offset_; }
 
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) override
 	{
-		assert( value_ == target );
-		if( replacement )
-			replacement->AddUse( this );
-		if( value_ )
-			value_->RemoveUse( this );
-		value_ = replacement;
+		assert( value_.get() == target );
+		value_.Set( replacement );
 	}
 
 	virtual void Accept( ILVisitor* visitor ) { visitor->VisitLocalVar( this ); }
 private:
 	int stack_offset_;
-	ILNode* value_;
+	ILUse value_;
 };
 
 class ILGlobalVar : public ILVar
@@ -279,6 +397,7 @@ class ILGlobalVar : public ILVar
 public:
 	ILGlobalVar( cell_t addr )
 		:
+		ILVar( ILNodeKind::GLOBAL_VAR ),
 		addr_( addr )
 	{}
 
@@ -294,6 +413,7 @@ class ILHeapVar : public ILVar
 public:
 	ILHeapVar( cell_t addr, cell_t size )
 		:
+		ILVar( ILNodeKind::HEAP_VAR ),
 		addr_( addr ),
 		size_( size )
 	{}
@@ -312,36 +432,31 @@ class ILArrayElementVar : public ILVar
 public:
 	ILArrayElementVar( ILNode* base, ILNode* index )
 		:
-		base_( base ),
-		index_( index )
-	{
-		base->AddUse( this );
-		index->AddUse( this );
-	}
+		ILVar( ILNodeKind::ARRAY_ELEMENT_VAR ),
+		base_( this, base ),
+		index_( this, index )
+	{}
 
-	ILNode* base() { return base_; }
-	ILNode* index() { return index_; }
+	ILNode* base() { return base_.get(); }
+	ILNode* index() { return index_.get(); }
 
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) override
 	{
-		assert( base_ == target || index_ == target );
-		replacement->AddUse( this );
-		if( base_ == target )
+		assert( base_.get() == target || index_.get() == target );
+		if( base_.get() == target )
 		{
-			base_->RemoveUse( this );
-			base_ = replacement;
+			base_.Set( replacement );
 		}
 		else
 		{
-			index_->RemoveUse( this );
-			index_ = replacement;
+			index_.Set( replacement );
 		}
 	}
 
 	virtual void Accept( ILVisitor* visitor ) { visitor->VisitArrayElementVar( this ); }
 private:
-	ILNode* base_;
-	ILNode* index_;
+	ILUse base_;
+	ILUse index_;
 };
 
 class ILFieldVar : public ILVar
@@ -349,6 +464,7 @@ class ILFieldVar : public ILVar
 public:
 	ILFieldVar( ILVar* base, size_t offset, SmxESField* field )
 		:
+		ILVar( ILNodeKind::FIELD_VAR ),
 		base_( base ),
 		offset_( offset ),
 		field_( field )
@@ -370,6 +486,7 @@ class ILTempVar : public ILVar
 public:
 	ILTempVar( size_t index, ILNode* value )
 		:
+		ILVar( ILNodeKind::TEMP_VAR ),
 		index_( index ),
 		value_( value )
 	{}
@@ -389,30 +506,28 @@ class ILLoad : public ILNode
 public:
 	ILLoad( ILVar* var, size_t width = 4 )
 		:
-		var_( var ),
-		width_( width )
+		ILNode( ILNodeKind::LOAD ),
+		width_( width ),
+		var_( this, var )
 	{
 		assert( width == 1 || width == 2 || width == 4 );
-		assert( var_ );
-		var->AddUse( this );
+		assert( var );
 	}
 
-	ILVar* var() { return var_; }
+	ILVar* var() { return static_cast<ILVar*>( var_.get() ); }
 	size_t width() const { return width_; }
 
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) override
 	{
-		assert( var_ == target && dynamic_cast<ILVar*>( target ) );
-		replacement->AddUse( this );
-		var_->RemoveUse( this );
-		var_ = dynamic_cast<ILVar*>( replacement );
-		assert( var_ );
+		assert( var_.get() == target && dynamic_cast<ILVar*>( target ) );
+		assert( dynamic_cast<ILVar*>( replacement ) );
+		var_.Set( replacement );
 	}
 
 	virtual void Accept( ILVisitor* visitor ) { visitor->VisitLoad( this ); }
 private:
 	size_t width_;
-	ILVar* var_;
+	ILUse var_;
 };
 
 class ILStore : public ILNode
@@ -420,41 +535,37 @@ class ILStore : public ILNode
 public:
 	ILStore( ILVar* var, ILNode* val, size_t width = 4 )
 		:
-		var_( var ),
-		val_( val ),
-		width_( width )
+		ILNode( ILNodeKind::STORE ),
+		width_( width ),
+		var_( this, var ),
+		val_( this, val )
 	{
 		assert( width == 1 || width == 2 || width == 4 );
-		var->AddUse( this );
-		val->AddUse( this );
 	}
 
 	size_t width() const { return width_; }
-	ILVar* var() { return var_; }
-	ILNode* val() { return val_; }
+	ILVar* var() { return static_cast<ILVar*>( var_.get() ); }
+	ILNode* val() { return val_.get(); }
 
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) override
 	{
-		assert( var_ == target || val_ == target );
-		replacement->AddUse( this );
-		if( var_ == target )
+		assert( var_.get() == target || val_.get() == target );
+		if( var_.get() == target )
 		{
-			var_->RemoveUse( this );
-			var_ = dynamic_cast<ILVar*>(replacement);
-			assert( var_ );
+			assert( dynamic_cast<ILVar*>( replacement ) );
+			var_.Set( replacement );
 		}
 		else
 		{
-			val_->RemoveUse( this );
-			val_ = replacement;
+			val_.Set( replacement );
 		}
 	}
 
 	virtual void Accept( ILVisitor* visitor ) { visitor->VisitStore( this ); }
 private:
 	size_t width_;
-	ILVar* var_;
-	ILNode* val_;
+	ILUse var_;
+	ILUse val_;
 };
 
 class ILJump : public ILNode
@@ -462,6 +573,7 @@ class ILJump : public ILNode
 public:
 	ILJump( ILBlock* target )
 		:
+		ILNode( ILNodeKind::JUMP ),
 		target_( target )
 	{}
 
@@ -483,14 +595,13 @@ class ILJumpCond : public ILNode
 public:
 	ILJumpCond( ILNode* condition, ILBlock* true_branch, ILBlock* false_branch )
 		:
-		condition_( condition ),
+		ILNode( ILNodeKind::JUMP_COND ),
+		condition_( this, condition ),
 		true_branch_( true_branch ),
 		false_branch_( false_branch )
-	{
-		condition_->AddUse( this );
-	}
+	{}
 
-	ILNode* condition() { return condition_; }
+	ILNode* condition() { return condition_.get(); }
 	ILBlock* true_branch() { return true_branch_; }
 	ILBlock* false_branch() { return false_branch_; }
 
@@ -505,15 +616,13 @@ public:
 	}
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) override
 	{
-		assert( condition_ == target );
-		replacement->AddUse( this );
-		condition_->RemoveUse( this );
-		condition_ = replacement;
+		assert( condition_.get() == target );
+		condition_.Set( replacement );
 	}
 
 	virtual void Accept( ILVisitor* visitor ) { visitor->VisitJumpCond( this ); }
 private:
-	ILNode* condition_;
+	ILUse condition_;
 	ILBlock* true_branch_;
 	ILBlock* false_branch_;
 };
@@ -529,29 +638,26 @@ class ILSwitch : public ILNode
 public:
 	ILSwitch( ILNode* value, ILBlock* default_case, std::vector<CaseTableEntry> cases )
 		:
-		value_( value ),
+		ILNode( ILNodeKind::SWITCH ),
+		value_( this, value ),
 		default_case_( default_case ),
 		cases_( std::move( cases ) )
-	{
-		value->AddUse( this );
-	}
+	{}
 
-	ILNode* value() { return value_; }
+	ILNode* value() { return value_.get(); }
 	ILBlock* default_case() { return default_case_; }
 	CaseTableEntry& case_entry( size_t index ) { return cases_[index]; }
 	size_t num_cases() const { return cases_.size(); }
 
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) override
 	{
-		assert( value_ == target );
-		replacement->AddUse( this );
-		value_->RemoveUse( this );
-		value_ = replacement;
+		assert( value_.get() == target );
+		value_.Set( replacement );
 	}
 
 	virtual void Accept( ILVisitor* visitor ) { visitor->VisitSwitch( this ); }
 private:
-	ILNode* value_;
+	ILUse value_;
 	ILBlock* default_case_;
 	std::vector<CaseTableEntry> cases_;
 };
@@ -559,32 +665,32 @@ private:
 class ILCallable : public ILNode
 {
 public:
-	void AddArg( ILNode* arg ) { args_.push_back( arg ); arg->AddUse( this ); }
+	explicit ILCallable( ILNodeKind kind ) : ILNode( kind ) {}
+
+	void AddArg( ILNode* arg ) { args_.emplace_back( this, arg ); }
 
 	size_t num_args() const { return args_.size(); }
-	ILNode* arg( size_t index ) { return args_[index]; }
+	ILNode* arg( size_t index ) { return args_[index].get(); }
 
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) override
 	{
-		replacement->AddUse( this );
 		for( size_t i = 0; i < args_.size(); i++ )
 		{
-			if( args_[i] == target )
+			if( args_[i].get() == target )
 			{
-				args_[i]->RemoveUse( this );
-				args_[i] = replacement;
+				args_[i].Set( replacement );
 				break;
 			}
 		}
 	}
 private:
-	std::vector<ILNode*> args_;
+	std::vector<ILUse> args_;
 };
 
 class ILCall : public ILCallable
 {
 public:
-	ILCall( cell_t addr ) : addr_( addr ) {}
+	ILCall( cell_t addr ) : ILCallable( ILNodeKind::CALL ), addr_( addr ) {}
 
 	cell_t addr() const { return addr_; }
 
@@ -596,7 +702,7 @@ private:
 class ILNative : public ILCallable
 {
 public:
-	ILNative( cell_t native_index ) : native_index_( native_index ) {}
+	ILNative( cell_t native_index ) : ILCallable( ILNodeKind::NATIVE ), native_index_( native_index ) {}
 
 	cell_t native_index() const { return native_index_; }
 
@@ -608,28 +714,26 @@ private:
 class ILReturn : public ILNode
 {
 public:
-	ILReturn( ILNode* value ) : value_( value ) { value->AddUse( this ); }
+	ILReturn( ILNode* value ) : ILNode( ILNodeKind::RETURN ), value_( this, value ) { assert( value ); }
 
-	ILNode* value() { return value_; }
+	ILNode* value() { return value_.get(); }
 
 	virtual void ReplaceParam( ILNode* target, ILNode* replacement ) override
 	{
-		assert( value_ == target );
-		if( replacement )
-			replacement->AddUse( this );
-		if( value_ )
-			value_->RemoveUse( this );
-		value_ = replacement;
+		assert( value_.get() == target );
+		value_.Set( replacement );
 	}
 
 	virtual void Accept( ILVisitor* visitor ) { visitor->VisitReturn( this ); }
 private:
-	ILNode* value_;
+	ILUse value_;
 };
 
 class ILPhi : public ILNode
 {
 public:
+	ILPhi() : ILNode( ILNodeKind::PHI ) {}
+
 	void AddInput( ILNode* input ) { inputs_.push_back( input ); }
 	size_t num_inputs() const { return inputs_.size(); }
 	ILNode* input( size_t index ) { return inputs_[index]; }
@@ -642,7 +746,7 @@ private:
 class ILInterval : public ILNode
 {
 public:
-	ILInterval( ILBlock* block ) : inner_( block ) {}
+	ILInterval( ILBlock* block ) : ILNode( ILNodeKind::INTERVAL ), inner_( block ) {}
 	
 	ILBlock* block() { return inner_; }
 
@@ -705,4 +809,117 @@ protected:
 		if( node->value() )
 			node->value()->Accept( this );
 	}
+};
+
+// Visitor dispatched with a switch on the node kind instead of Accept, so handlers can be inlined.
+// Derived passes pass themselves as Derived and hide the Visit functions they handle.
+// Built-in passes use this, ILVisitor is still there for anything wanting virtual dispatch
+template <typename Derived>
+class StaticILVisitor
+{
+public:
+	void Visit( ILNode* node )
+	{
+		Derived* self = static_cast<Derived*>( this );
+		switch( node->kind() )
+		{
+		case ILNodeKind::CONST:             self->VisitConst( static_cast<ILConst*>( node ) ); break;
+		case ILNodeKind::UNARY:             self->VisitUnary( static_cast<ILUnary*>( node ) ); break;
+		case ILNodeKind::BINARY:            self->VisitBinary( static_cast<ILBinary*>( node ) ); break;
+		case ILNodeKind::LOCAL_VAR:         self->VisitLocalVar( static_cast<ILLocalVar*>( node ) ); break;
+		case ILNodeKind::GLOBAL_VAR:        self->VisitGlobalVar( static_cast<ILGlobalVar*>( node ) ); break;
+		case ILNodeKind::HEAP_VAR:          self->VisitHeapVar( static_cast<ILHeapVar*>( node ) ); break;
+		case ILNodeKind::ARRAY_ELEMENT_VAR: self->VisitArrayElementVar( static_cast<ILArrayElementVar*>( node ) ); break;
+		case ILNodeKind::FIELD_VAR:         self->VisitFieldVar( static_cast<ILFieldVar*>( node ) ); break;
+		case ILNodeKind::TEMP_VAR:          self->VisitTempVar( static_cast<ILTempVar*>( node ) ); break;
+		case ILNodeKind::LOAD:              self->VisitLoad( static_cast<ILLoad*>( node ) ); break;
+		case ILNodeKind::STORE:             self->VisitStore( static_cast<ILStore*>( node ) ); break;
+		case ILNodeKind::JUMP:              self->VisitJump( static_cast<ILJump*>( node ) ); break;
+		case ILNodeKind::JUMP_COND:         self->VisitJumpCond( static_cast<ILJumpCond*>( node ) ); break;
+		case ILNodeKind::SWITCH:            self->VisitSwitch( static_cast<ILSwitch*>( node ) ); break;
+		case ILNodeKind::CALL:              self->VisitCall( static_cast<ILCall*>( node ) ); break;
+		case ILNodeKind::NATIVE:            self->VisitNative( static_cast<ILNative*>( node ) ); break;
+		case ILNodeKind::RETURN:            self->VisitReturn( static_cast<ILReturn*>( node ) ); break;
+		case ILNodeKind::PHI:               self->VisitPhi( static_cast<ILPhi*>( node ) ); break;
+		case ILNodeKind::INTERVAL:          self->VisitInterval( static_cast<ILInterval*>( node ) ); break;
+		}
+	}
+
+	void VisitConst( ILConst* node ) {}
+	void VisitUnary( ILUnary* node ) {}
+	void VisitBinary( ILBinary* node ) {}
+	void VisitLocalVar( ILLocalVar* node ) {}
+	void VisitGlobalVar( ILGlobalVar* node ) {}
+	void VisitHeapVar( ILHeapVar* node ) {}
+	void VisitArrayElementVar( ILArrayElementVar* node ) {}
+	void VisitFieldVar( ILFieldVar* node ) {}
+	void VisitTempVar( ILTempVar* node ) {}
+	void VisitLoad( ILLoad* node ) {}
+	void VisitStore( ILStore* node ) {}
+	void VisitJump( ILJump* node ) {}
+	void VisitJumpCond( ILJumpCond* node ) {}
+	void VisitSwitch( ILSwitch* node ) {}
+	void VisitCall( ILCall* node ) {}
+	void VisitNative( ILNative* node ) {}
+	void VisitReturn( ILReturn* node ) {}
+	void VisitPhi( ILPhi* node ) {}
+	void VisitInterval( ILInterval* node ) {}
+};
+
+// Same traversal as RecursiveILVisitor
+template <typename Derived>
+class StaticRecursiveILVisitor : public StaticILVisitor<Derived>
+{
+public:
+	void VisitUnary( ILUnary* node )
+	{
+		this->Visit( node->val() );
+	}
+	void VisitBinary( ILBinary* node )
+	{
+		this->Visit( node->left() );
+		this->Visit( node->right() );
+	}
+	void VisitLocalVar( ILLocalVar* node )
+	{
+		if( node->value() )
+			this->Visit( node->value() );
+	}
+	void VisitArrayElementVar( ILArrayElementVar* node )
+	{
+		this->Visit( node->base() );
+		this->Visit( node->index() );
+	}
+	void VisitLoad( ILLoad* node )
+	{
+		this->Visit( node->var() );
+	}
+	void VisitStore( ILStore* node )
+	{
+		this->Visit( node->var() );
+		this->Visit( node->val() );
+	}
+	void VisitJumpCond( ILJumpCond* node )
+	{
+		this->Visit( node->condition() );
+	}
+	void VisitSwitch( ILSwitch* node )
+	{
+		this->Visit( node->value() );
+	}
+	void VisitCall( ILCall* node )
+	{
+		for( size_t i = 0; i < node->num_args(); i++ )
+			this->Visit( node->arg( i ) );
+	}
+	void VisitNative( ILNative* node )
+	{
+		for( size_t i = 0; i < node->num_args(); i++ )
+			this->Visit( node->arg( i ) );
+	}
+	void VisitReturn( ILReturn* node )
+	{
+		if( node->value() )
+			this->Visit( node->value() );
+	}
 };
\ No newline at end of file
@@ -0,0 +1,351 @@
+#include "json.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+
+bool JsonValue::Parse( const std::string& text, JsonValue& value )
+{
+	const char* p = text.c_str();
+	value = JsonValue();
+	if( !value.ParseValue( p ) )
+		return false;
+
+	SkipSpace( p );
+	return *p == '\0';
+}
+
+const JsonValue* JsonValue::Find( const char* key ) const
+{
+	if( type_ != Type::OBJECT )
+		return nullptr;
+
+	for( size_t i = 0; i < keys_.size(); i++ )
+	{
+		if( keys_[i] == key )
+			return &elements_[i];
+	}
+	return nullptr;
+}
+
+bool JsonValue::ParseValue( const char*& p )
+{
+	SkipSpace( p );
+	switch( *p )
+	{
+	case '{':
+	{
+		type_ = Type::OBJECT;
+		p++;
+		SkipSpace( p );
+		if( *p == '}' )
+		{
+			p++;
+			return true;
+		}
+		for( ;; )
+		{
+			SkipSpace( p );
+			std::string key;
+			if( !ParseString( p, key ) )
+				return false;
+			SkipSpace( p );
+			if( *p++ != ':' )
+				return false;
+
+			elements_.emplace_back();
+			if( !elements_.back().ParseValue( p ) )
+				return false;
+			keys_.push_back( std::move( key ) );
+
+			SkipSpace( p );
+			if( *p == ',' )
+			{
+				p++;
+				continue;
+			}
+			if( *p++ != '}' )
+				return false;
+			return true;
+		}
+	}
+	case '[':
+	{
+		type_ = Type::ARRAY;
+		p++;
+		SkipSpace( p );
+		if( *p == ']' )
+		{
+			p++;
+			return true;
+		}
+		for( ;; )
+		{
+			elements_.emplace_back();
+			if( !elements_.back().ParseValue( p ) )
+				return false;
+
+			SkipSpace( p );
+			if( *p == ',' )
+			{
+				p++;
+				continue;
+			}
+			if( *p++ != ']' )
+				return false;
+			return true;
+		}
+	}
+	case '"':
+		type_ = Type::STRING;
+		return ParseString( p, string_ );
+	case 't':
+		type_ = Type::BOOL;
+		bool_ = true;
+		if( strncmp( p, "true", 4 ) != 0 )
+			return false;
+		p += 4;
+		return true;
+	case 'f':
+		type_ = Type::BOOL;
+		bool_ = false;
+		if( strncmp( p, "false", 5 ) != 0 )
+			return false;
+		p += 5;
+		return true;
+	case 'n':
+		type_ = Type::NUL;
+		if( strncmp( p, "null", 4 ) != 0 )
+			return false;
+		p += 4;
+		return true;
+	default:
+	{
+		char* end;
+		type_ = Type::NUMBER;
+		number_ = strtod( p, &end );
+		if( end == p )
+			return false;
+		p = end;
+		return true;
+	}
+	}
+}
+
+bool JsonValue::ParseString( const char*& p, std::string& out )
+{
+	if( *p++ != '"' )
+		return false;
+
+	while( *p != '"' )
+	{
+		if( *p == '\0' )
+			return false;
+
+		if( *p != '\\' )
+		{
+			out += *p++;
+			continue;
+		}
+
+		p++;
+		switch( *p++ )
+		{
+		case '"':  out += '"'; break;
+		case '\\': out += '\\'; break;
+		case '/':  out += '/'; break;
+		case 'b':  out += '\b'; break;
+		case 'f':  out += '\f'; break;
+		case 'n':  out += '\n'; break;
+		case 'r':  out += '\r'; break;
+		case 't':  out += '\t'; break;
+		case 'u':
+		{
+			unsigned int c = 0;
+			for( int i = 0; i < 4; i++, p++ )
+			{
+				c <<= 4;
+				if( *p >= '0' && *p <= '9' )
+					c |= *p - '0';
+				else if( *p >= 'a' && *p <= 'f' )
+					c |= *p - 'a' + 10;
+				else if( *p >= 'A' && *p <= 'F' )
+					c |= *p - 'A' + 10;
+				else
+					return false;
+			}
+
+			// Encode as UTF-8, surrogate pairs aren't combined
+			if( c < 0x80 )
+			{
+				out += (char)c;
+			}
+			else if( c < 0x800 )
+			{
+				out += (char)(0xC0 | (c >> 6));
+				out += (char)(0x80 | (c & 0x3F));
+			}
+			else
+			{
+				out += (char)(0xE0 | (c >> 12));
+				out += (char)(0x80 | ((c >> 6) & 0x3F));
+				out += (char)(0x80 | (c & 0x3F));
+			}
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+
+	p++;
+	return true;
+}
+
+void JsonValue::SkipSpace( const char*& p )
+{
+	while( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' )
+		p++;
+}
+
+JsonWriter& JsonWriter::BeginObject()
+{
+	BeginValue();
+	out_ += '{';
+	first_.push_back( true );
+	return *this;
+}
+
+JsonWriter& JsonWriter::EndObject()
+{
+	out_ += '}';
+	first_.pop_back();
+	return *this;
+}
+
+JsonWriter& JsonWriter::BeginArray()
+{
+	BeginValue();
+	out_ += '[';
+	first_.push_back( true );
+	return *this;
+}
+
+JsonWriter& JsonWriter::EndArray()
+{
+	out_ += ']';
+	first_.pop_back();
+	return *this;
+}
+
+JsonWriter& JsonWriter::Key( const char* key )
+{
+	BeginValue();
+	AppendEscaped( key );
+	out_ += ':';
+	after_key_ = true;
+	return *this;
+}
+
+JsonWriter& JsonWriter::String( const char* str )
+{
+	BeginValue();
+	if( str )
+		AppendEscaped( str );
+	else
+		out_ += "null";
+	return *this;
+}
+
+JsonWriter& JsonWriter::Number( int64_t val )
+{
+	BeginValue();
+	out_ += std::to_string( val );
+	return *this;
+}
+
+JsonWriter& JsonWriter::Number( double val )
+{
+	BeginValue();
+	if( !std::isfinite( val ) )
+	{
+		out_ += "null";
+		return *this;
+	}
+
+	char buf[32];
+	snprintf( buf, sizeof( buf ), "%.15g", val );
+	out_ += buf;
+	return *this;
+}
+
+JsonWriter& JsonWriter::Bool( bool val )
+{
+	BeginValue();
+	out_ += val ? "true" : "false";
+	return *this;
+}
+
+JsonWriter& JsonWriter::Null()
+{
+	BeginValue();
+	out_ += "null";
+	return *this;
+}
+
+JsonWriter& JsonWriter::Raw( const std::string& json )
+{
+	BeginValue();
+	out_ += json;
+	return *this;
+}
+
+void JsonWriter::BeginValue()
+{
+	// Values straight after a key never need a comma, the key already took care of it
+	if( after_key_ )
+	{
+		after_key_ = false;
+		return;
+	}
+
+	if( !first_.empty() )
+	{
+		if( !first_.back() )
+			out_ += ',';
+		first_.back() = false;
+	}
+}
+
+void JsonWriter::AppendEscaped( const char* str )
+{
+	static const char hex[] = "0123456789abcdef";
+
+	out_ += '"';
+	for( const char* c = str; *c; c++ )
+	{
+		switch( *c )
+		{
+		case '"':  out_ += "\\\""; break;
+		case '\\': out_ += "\\\\"; break;
+		case '\b': out_ += "\\b"; break;
+		case '\f': out_ += "\\f"; break;
+		case '\n': out_ += "\\n"; break;
+		case '\r': out_ += "\\r"; break;
+		case '\t': out_ += "\\t"; break;
+		default:
+			if( (unsigned char)*c < 0x20 )
+			{
+				out_ += "\\u00";
+				out_ += hex[(*c >> 4) & 0xF];
+				out_ += hex[*c & 0xF];
+			}
+			else
+			{
+				out_ += *c;
+			}
+		}
+	}
+	out_ += '"';
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Minimal JSON value, just enough for reading the requests accepted in server mode
+class JsonValue
+{
+public:
+	enum class Type
+	{
+		NUL,
+		BOOL,
+		NUMBER,
+		STRING,
+		ARRAY,
+		OBJECT
+	};
+
+	// Returns false if the text isn't a single valid JSON value
+	static bool Parse( const std::string& text, JsonValue& value );
+
+	Type type() const { return type_; }
+	bool IsNull() const { return type_ == Type::NUL; }
+
+	bool AsBool( bool def = false ) const { return type_ == Type::BOOL ? bool_ : def; }
+	double AsNumber( double def = 0.0 ) const { return type_ == Type::NUMBER ? number_ : def; }
+	const char* AsString( const char* def = nullptr ) const { return type_ == Type::STRING ? string_.c_str() : def; }
+
+	size_t num_elements() const { return elements_.size(); }
+	const JsonValue& element( size_t index ) const { return elements_[index]; }
+
+	// Returns nullptr if this isn't an object or it has no member with that key
+	const JsonValue* Find( const char* key ) const;
+private:
+	bool ParseValue( const char*& p );
+	static bool ParseString( const char*& p, std::string& out );
+	static void SkipSpace( const char*& p );
+private:
+	Type type_ = Type::NUL;
+	bool bool_ = false;
+	double number_ = 0.0;
+	std::string string_;
+	std::vector<JsonValue> elements_;
+	std::vector<std::string> keys_; // Only for objects, parallel to elements_
+};
+
+// Builds compact JSON text, commas between members/elements are inserted automatically
+class JsonWriter
+{
+public:
+	JsonWriter& BeginObject();
+	JsonWriter& EndObject();
+	JsonWriter& BeginArray();
+	JsonWriter& EndArray();
+	JsonWriter& Key( const char* key );
+
+	JsonWriter& String( const char* str );
+	JsonWriter& String( const std::string& str ) { return String( str.c_str() ); }
+	JsonWriter& Number( int64_t val );
+	JsonWriter& Number( double val );
+	JsonWriter& Bool( bool val );
+	JsonWriter& Null();
+
+	// Appends already serialized JSON as a value
+	JsonWriter& Raw( const std::string& json );
+
+	const std::string& str() const { return out_; }
+	void Clear() { out_.clear(); first_.clear(); after_key_ = false; }
+private:
+	void BeginValue();
+	void AppendEscaped( const char* str );
+private:
+	std::string out_;
+	std::vector<bool> first_; // Whether the next member/element at each nesting level is the first
+	bool after_key_ = false;
+};
@@ -2,7 +2,9 @@
 
 #include "il.h"
 #include "smx-opcodes.h"
+#include "trace.h"
 #include <cassert>
+#include <set>
 
 ILControlFlowGraph* PcodeLifter::Lift( const ControlFlowGraph& cfg )
 {
@@ -19,29 +21,41 @@ ILControlFlowGraph* PcodeLifter::Lift( const ControlFlowGraph& cfg )
 	}
 
 	block_stacks_.resize( ilcfg_->num_blocks() );
-	for( size_t i = 0; i < cfg.num_blocks(); i++ )
 	{
-		BasicBlock& bb = cfg.block( i );
-		ILBlock& ilbb = ilcfg_->block( i );
-		LiftBlock( bb, ilbb );
+		TraceSpan span( "LiftBlock" );
+		for( size_t i = 0; i < cfg.num_blocks(); i++ )
+		{
+			BasicBlock& bb = cfg.block( i );
+			ILBlock& ilbb = ilcfg_->block( i );
+			LiftBlock( cfg.edges(), bb, ilbb );
+		}
 	}
 
 	ilcfg_->ComputeDominance();
 
-	for( size_t i = 0; i < cfg.num_blocks(); i++ )
 	{
-		ILBlock& ilbb = ilcfg_->block( i );
-		CleanCalls( ilbb );
+		TraceSpan span( "CleanCalls" );
+		for( size_t i = 0; i < cfg.num_blocks(); i++ )
+		{
+			ILBlock& ilbb = ilcfg_->block( i );
+			CleanCalls( ilbb );
+		}
 	}
-	for( size_t i = 0; i < cfg.num_blocks(); i++ )
 	{
-		ILBlock& ilbb = ilcfg_->block( i );
-		PruneVarsInBlock( ilbb );
+		TraceSpan span( "PruneVarsInBlock" );
+		for( size_t i = 0; i < cfg.num_blocks(); i++ )
+		{
+			ILBlock& ilbb = ilcfg_->block( i );
+			PruneVarsInBlock( ilbb );
+		}
 	}
-	for( size_t i = 0; i < cfg.num_blocks(); i++ )
 	{
-		ILBlock& ilbb = ilcfg_->block( i );
-		MovePhis( ilbb );
+		TraceSpan span( "MovePhis" );
+		for( size_t i = 0; i < cfg.num_blocks(); i++ )
+		{
+			ILBlock& ilbb = ilcfg_->block( i );
+			MovePhis( ilbb );
+		}
 	}
 
 	CompoundConditions();
@@ -53,32 +67,34 @@ ILControlFlowGraph* PcodeLifter::Lift( const ControlFlowGraph& cfg )
 	return ilcfg_;
 }
 
-void PcodeLifter::LiftBlock( BasicBlock& bb, ILBlock& ilbb )
+void PcodeLifter::LiftBlock( const BlockEdges& edges, BasicBlock& bb, ILBlock& ilbb )
 {
 	expr_stack_ = &block_stacks_[ilbb.id()];
 	ILNode*& pri = expr_stack_->pri;
 	ILNode*& alt = expr_stack_->alt;
 
-	for( size_t i = 0; i < bb.num_out_edges(); i++ )
+	for( size_t i = 0; i < edges.num_out_edges( bb.id() ); i++ )
 	{
-		BasicBlock* out = bb.out_edge( i );
-		ILBlock& ilout = ilcfg_->block( out->id() );
+		ILBlock& ilout = ilcfg_->block( edges.out_edge( bb.id(), i ) );
 		ilbb.AddTarget( ilout );
 	}
 
-	for( size_t i = 0; i < bb.num_in_edges(); i++ )
+	for( size_t i = 0; i < edges.num_in_edges( bb.id() ); i++ )
 	{
-		BasicBlock* in = bb.in_edge( i );
+		size_t in = edges.in_edge( bb.id(), i );
 
 		// No back edges
-		if( in->id() >= bb.id() )
+		if( in >= bb.id() )
 		{
 			continue;
 		}
 
 		if( expr_stack_->stack.empty() )
 		{
-			*expr_stack_ = block_stacks_[in->id()];
+			AbstractExprStack& in_stack = block_stacks_[in];
+			expr_stack_->stack = in_stack.stack.Share();
+			expr_stack_->pri = in_stack.pri;
+			expr_stack_->alt = in_stack.alt;
 		}
 		else
 		{
@@ -92,8 +108,8 @@ void PcodeLifter::LiftBlock( BasicBlock& bb, ILBlock& ilbb )
 				}
 				phi->AddInput( value );
 			};
-			join_reg( pri, block_stacks_[in->id()].pri );
-			join_reg( alt, block_stacks_[in->id()].alt );
+			join_reg( pri, block_stacks_[in].pri );
+			join_reg( alt, block_stacks_[in].alt );
 		}
 	}
 
@@ -799,9 +815,10 @@ void PcodeLifter::LiftBlock( BasicBlock& bb, ILBlock& ilbb )
 
 void PcodeLifter::CleanCalls( ILBlock& ilbb )
 {
-	for( int i = (int)ilbb.num_nodes() - 1; i >= 0; i-- )
+	for( ILNode* node = ilbb.Last(), *prev; node; node = prev )
 	{
-		if( auto* var = dynamic_cast<ILTempVar*>(ilbb.node( i )) )
+		prev = node->prev();
+		if( auto* var = dynamic_cast<ILTempVar*>(node) )
 		{
 			ILCallable* call = dynamic_cast<ILCallable*>(var->value());
 			if( !call )
@@ -813,13 +830,13 @@ void PcodeLifter::CleanCalls( ILBlock& ilbb )
 			{
 				// If call result is not used anywhere, remove the temp var
 				// Can't remove call entirely since it may have side effects
-				ilbb.Replace( i, call );
+				ilbb.Replace( var, call );
 			}
 			else if( var->num_uses() == 1 )
 			{
 				// Just use call node directly at use site rather than going through temp var
 				var->ReplaceUsesWith( call );
-				ilbb.Remove( i );
+				ilbb.Remove( var );
 			}
 		}
 	}
@@ -827,13 +844,14 @@ void PcodeLifter::CleanCalls( ILBlock& ilbb )
 
 void PcodeLifter::PruneVarsInBlock( ILBlock& ilbb )
 {
-	for( int i = (int)ilbb.num_nodes() - 1; i >= 0; i-- )
+	for( ILNode* node = ilbb.Last(), *prev; node; node = prev )
 	{
-		if( auto* var = dynamic_cast<ILVar*>(ilbb.node( i )) )
+		prev = node->prev();
+		if( auto* var = dynamic_cast<ILVar*>(node) )
 		{
 			if( var->num_uses() == 0 )
 			{
-				ilbb.Remove( i );
+				ilbb.Remove( var );
 			}
 		}
 	}
@@ -842,14 +860,16 @@ void PcodeLifter::PruneVarsInBlock( ILBlock& ilbb )
 void PcodeLifter::MovePhis( ILBlock& ilbb )
 {
 	// Turn phis into stores on incoming edges
-	for( int i = (int)ilbb.num_nodes() - 1; i >= 0; i-- )
+	for( ILNode* node = ilbb.Last(), *prev; node; node = prev )
 	{
-		if( auto* tmp = dynamic_cast<ILTempVar*>(ilbb.node( i )) )
+		prev = node->prev();
+		if( auto* tmp = dynamic_cast<ILTempVar*>(node) )
 		{
 			if( auto* phi = dynamic_cast<ILPhi*>(tmp->value()) )
 			{
-				// Add declaration at immed_dominator
+				// Move declaration to immed_dominator
 				tmp->SetValue( nullptr );
+				ilbb.Remove( tmp );
 				ilbb.immed_dominator()->AddToEnd( tmp );
 
 				// Add stores on incoming edges
@@ -859,9 +879,6 @@ void PcodeLifter::MovePhis( ILBlock& ilbb )
 					ILBlock& in = ilbb.in_edge( inp );
 					in.AddToEnd( new ILStore( tmp, phi->input( inp ) ) );
 				}
-
-				// Remove from current block
-				ilbb.Remove( i );
 			}
 		}
 	}
@@ -869,61 +886,98 @@ void PcodeLifter::MovePhis( ILBlock& ilbb )
 
 void PcodeLifter::CompoundConditions() const
 {
-	bool changed = true;
-	while( changed )
+	TraceSpan span( "CompoundConditions" );
+
+	// Blocks are visited in rounds of ascending id, like sweeping over the whole graph repeatedly,
+	// except only blocks next to a merge get revisited. Blocks ahead of the current one are still
+	// handled in the current round and the rest in the next one, so chains pair up the same way
+	// a full sweep would. Ids stay the same for the whole pass since removed blocks are only
+	// dropped on the next compaction
+	std::set<size_t> worklist;
+	std::set<size_t> next_round;
+	for( size_t i = 0; i < ilcfg_->num_blocks(); i++ )
+	{
+		if( ilcfg_->block( i ).num_out_edges() == 2 )
+			worklist.insert( i );
+	}
+
+	while( !worklist.empty() || !next_round.empty() )
 	{
-		changed = false;
+		if( worklist.empty() )
+			worklist.swap( next_round );
 
-		for( size_t i = 0; i < ilcfg_->num_blocks(); i++ )
+		DecompileBudget::Check();
+		size_t current = *worklist.begin();
+		worklist.erase( worklist.begin() );
+
+		ILBlock& bb = ilcfg_->block( current );
+		if( bb.IsRemoved() || !CompoundCondition( bb ) )
+			continue;
+
+		// The merge changes the out edges of bb and the in edges of its new targets, so only
+		// bb, blocks branching into bb and blocks sharing a target with bb can match again
+		auto requeue = [&]( ILBlock& block ) { (block.id() > current ? worklist : next_round).insert( block.id() ); };
+		requeue( bb );
+		for( size_t i = 0; i < bb.num_in_edges(); i++ )
+			requeue( bb.in_edge( i ) );
+		for( size_t i = 0; i < bb.num_out_edges(); i++ )
 		{
-			ILBlock& bb = ilcfg_->block( i );
-			if( bb.num_out_edges() != 2 || dynamic_cast<ILSwitch*>(bb.Last()) )
-				continue;
+			ILBlock& target = bb.out_edge( i );
+			for( size_t j = 0; j < target.num_in_edges(); j++ )
+				requeue( target.in_edge( j ) );
+		}
+	}
+}
 
-			ILBlock& then_branch = bb.out_edge( 0 );
-			ILBlock& else_branch = bb.out_edge( 1 );
+bool PcodeLifter::CompoundCondition( ILBlock& bb ) const
+{
+	if( bb.num_out_edges() != 2 || dynamic_cast<ILSwitch*>(bb.Last()) )
+		return false;
 
-			// X || Y
-			if( else_branch.num_out_edges() == 2 &&
-				else_branch.num_nodes() == 1 &&
-				else_branch.num_in_edges() == 1 &&
-				&else_branch.out_edge( 0 ) == &then_branch )
-			{
-				CompoundXandY( bb, else_branch, then_branch, else_branch.out_edge( 1 ) );
-				changed = true;
-			}
+	ILBlock& then_branch = bb.out_edge( 0 );
+	ILBlock& else_branch = bb.out_edge( 1 );
 
-			// X && Y
-			if( then_branch.num_out_edges() == 2 &&
-				then_branch.num_nodes() == 1 &&
-				then_branch.num_in_edges() == 1 &&
-				&then_branch.out_edge( 1 ) == &else_branch )
-			{
-				CompoundXorY( bb, then_branch, then_branch.out_edge( 0 ), else_branch );
-				changed = true;
-			}
+	// X || Y
+	if( else_branch.num_out_edges() == 2 &&
+		else_branch.num_nodes() == 1 &&
+		else_branch.num_in_edges() == 1 &&
+		&else_branch.out_edge( 0 ) == &then_branch )
+	{
+		CompoundXandY( bb, else_branch, then_branch, else_branch.out_edge( 1 ) );
+		return true;
+	}
 
-			// !X || Y
-			if( else_branch.num_out_edges() == 2 &&
-				else_branch.num_nodes() == 1 &&
-				else_branch.num_in_edges() == 1 &&
-				&else_branch.out_edge( 1 ) == &then_branch )
-			{
-				CompoundNotXandY( bb, else_branch, then_branch, else_branch.out_edge( 0 ) );
-				changed = true;
-			}
+	// X && Y
+	if( then_branch.num_out_edges() == 2 &&
+		then_branch.num_nodes() == 1 &&
+		then_branch.num_in_edges() == 1 &&
+		&then_branch.out_edge( 1 ) == &else_branch )
+	{
+		CompoundXorY( bb, then_branch, then_branch.out_edge( 0 ), else_branch );
+		return true;
+	}
 
-			// !X && Y
-			if( then_branch.num_out_edges() == 2 &&
-				then_branch.num_nodes() == 1 &&
-				then_branch.num_in_edges() == 1 &&
-				&then_branch.out_edge( 0 ) == &else_branch )
-			{
-				CompoundNotXorY( bb, then_branch, then_branch.out_edge( 1 ), else_branch );
-				changed = true;
-			}
-		}
+	// !X || Y
+	if( else_branch.num_out_edges() == 2 &&
+		else_branch.num_nodes() == 1 &&
+		else_branch.num_in_edges() == 1 &&
+		&else_branch.out_edge( 1 ) == &then_branch )
+	{
+		CompoundNotXandY( bb, else_branch, then_branch, else_branch.out_edge( 0 ) );
+		return true;
+	}
+
+	// !X && Y
+	if( then_branch.num_out_edges() == 2 &&
+		then_branch.num_nodes() == 1 &&
+		then_branch.num_in_edges() == 1 &&
+		&then_branch.out_edge( 0 ) == &else_branch )
+	{
+		CompoundNotXorY( bb, then_branch, then_branch.out_edge( 1 ), else_branch );
+		return true;
 	}
+
+	return false;
 }
 
 void PcodeLifter::CompoundXandY( ILBlock& x, ILBlock& y, ILBlock& then_branch, ILBlock& else_branch ) const
@@ -940,7 +994,7 @@ void PcodeLifter::CompoundXandY( ILBlock& x, ILBlock& y, ILBlock& then_branch, I
 		&then_branch,
 		&else_branch );
 
-	x.Replace( x.num_nodes() - 1, new_cond );
+	x.Replace( x_cond, new_cond );
 
 	x.ReplaceOutEdge( y, else_branch );
 	else_branch.ReplaceInEdge( y, x );
@@ -959,7 +1013,7 @@ void PcodeLifter::CompoundXorY( ILBlock& x, ILBlock& y, ILBlock& then_branch, IL
 		&then_branch,
 		&else_branch );
 
-	x.Replace( x.num_nodes() - 1, new_cond );
+	x.Replace( x_cond, new_cond );
 
 	x.ReplaceOutEdge( y, then_branch );
 	then_branch.ReplaceInEdge( y, x );
@@ -982,7 +1036,7 @@ void PcodeLifter::CompoundNotXorY( ILBlock& x, ILBlock& y, ILBlock& then_branch,
 
 	new_cond->Invert();
 
-	x.Replace( x.num_nodes() - 1, new_cond );
+	x.Replace( x_cond, new_cond );
 
 	x.ReplaceOutEdge( y, then_branch );
 	then_branch.ReplaceInEdge( y, x );
@@ -1005,7 +1059,7 @@ void PcodeLifter::CompoundNotXandY( ILBlock& x, ILBlock& y, ILBlock& then_branch
 
 	new_cond->Invert();
 
-	x.Replace( x.num_nodes() - 1, new_cond );
+	x.Replace( x_cond, new_cond );
 
 	x.ReplaceOutEdge( y, else_branch );
 	else_branch.ReplaceInEdge( y, x );
@@ -1013,6 +1067,60 @@ void PcodeLifter::CompoundNotXandY( ILBlock& x, ILBlock& y, ILBlock& then_branch
 	ilcfg_->Remove( y );
 }
 
+void PcodeLifter::SharedExprStack::pop_back()
+{
+	if( !top_.empty() )
+	{
+		top_.pop_back();
+		return;
+	}
+
+	// Popping into the shared part only hides the entry, the segment itself is left alone
+	assert( base_size_ );
+	base_size_--;
+}
+
+PcodeLifter::SharedExprStack PcodeLifter::SharedExprStack::Share()
+{
+	// Chains get flattened every so often so lookups never have to walk too many segments
+	static constexpr size_t kMaxDepth = 16;
+
+	if( !top_.empty() )
+	{
+		auto segment = std::make_shared<Segment>();
+		if( base_ && base_->depth >= kMaxDepth )
+		{
+			segment->parent_size = 0;
+			segment->depth = 1;
+			segment->entries.reserve( size() );
+			for( size_t i = 0; i < base_size_; i++ )
+				segment->entries.push_back( Lookup( i ) );
+			segment->entries.insert( segment->entries.end(), top_.begin(), top_.end() );
+		}
+		else
+		{
+			segment->parent = base_;
+			segment->parent_size = base_size_;
+			segment->depth = base_ ? base_->depth + 1 : 1;
+			segment->entries = std::move( top_ );
+		}
+
+		base_size_ = segment->parent_size + segment->entries.size();
+		base_ = std::move( segment );
+		top_.clear();
+	}
+
+	return *this;
+}
+
+ILLocalVar* PcodeLifter::SharedExprStack::Lookup( size_t index ) const
+{
+	const Segment* segment = base_.get();
+	while( index < segment->parent_size )
+		segment = segment->parent.get();
+	return segment->entries[index - segment->parent_size];
+}
+
 ILLocalVar* PcodeLifter::Push( ILNode* value )
 {
 	int offset = (ilcfg_->nargs() + 3) - (int)expr_stack_->stack.size() - 1;
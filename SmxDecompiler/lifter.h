@@ -3,6 +3,8 @@
 #include "smx-file.h"
 #include "il-cfg.h"
 #include "cfg.h"
+#include <memory>
+#include <vector>
 
 class ILLocalVar;
 
@@ -13,11 +15,12 @@ public:
 
 	ILControlFlowGraph* Lift( const ControlFlowGraph& cfg );
 private:
-	void LiftBlock( BasicBlock& bb, ILBlock& ilbb );
+	void LiftBlock( const BlockEdges& edges, BasicBlock& bb, ILBlock& ilbb );
 	void CleanCalls( ILBlock& ilbb );
 	void PruneVarsInBlock( ILBlock& ilbb );
 	void MovePhis( ILBlock& ilbb );
 	void CompoundConditions() const;
+	bool CompoundCondition( ILBlock& bb ) const;
 	void CompoundXorY( ILBlock& x, ILBlock& y, ILBlock& then_branch, ILBlock& else_branch ) const;
 	void CompoundXandY( ILBlock& x, ILBlock& y, ILBlock& then_branch, ILBlock& else_branch ) const;
 	void CompoundNotXorY( ILBlock& x, ILBlock& y, ILBlock& then_branch, ILBlock& else_branch ) const;
@@ -36,9 +39,40 @@ private:
 	const SmxFile* smx_;
 	ILControlFlowGraph* ilcfg_;
 
+	// Stack of local vars where blocks share the entries inherited from their predecessor.
+	// Entries a block pushes stay private to it until a successor takes a copy with Share,
+	// at which point they're frozen into a segment that both refer to
+	class SharedExprStack
+	{
+	public:
+		bool empty() const { return size() == 0; }
+		size_t size() const { return base_size_ + top_.size(); }
+		ILLocalVar* back() const { return top_.empty() ? Lookup( base_size_ - 1 ) : top_.back(); }
+		ILLocalVar* operator[]( size_t index ) const { return index < base_size_ ? Lookup( index ) : top_[index - base_size_]; }
+
+		void push_back( ILLocalVar* var ) { top_.push_back( var ); }
+		void pop_back();
+
+		SharedExprStack Share();
+	private:
+		struct Segment
+		{
+			std::shared_ptr<const Segment> parent;
+			size_t parent_size; // Number of parent entries below this segment
+			size_t depth;
+			std::vector<ILLocalVar*> entries;
+		};
+
+		ILLocalVar* Lookup( size_t index ) const;
+	private:
+		std::shared_ptr<const Segment> base_;
+		size_t base_size_ = 0; // Entries of base_ still on the stack, can be less than it holds after pops
+		std::vector<ILLocalVar*> top_;
+	};
+
 	struct AbstractExprStack
 	{
-		std::vector<ILLocalVar*> stack;
+		SharedExprStack stack;
 		ILNode* pri;
 		ILNode* alt;
 	};
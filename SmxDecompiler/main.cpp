@@ -1,11 +1,233 @@
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <cstdlib>
+#include <set>
 #include "optparse.h"
 #include "smx-file.h"
 #include "decompiler.h"
+#include "server.h"
+#include "xrefs.h"
+#include "corpus-index.h"
+#include "fingerprint.h"
+#include "diff.h"
+#include "batch.h"
+#include "trace.h"
+#include "json.h"
 
 using namespace std::string_literals;
 
+static DecompilerOptions ParseDecompilerOptions( const OptParse& args )
+{
+	DecompilerOptions options;
+	options.print_globals = !args["no-globals"];
+	options.print_il = args["il"];
+	options.print_assembly = args["assembly"];
+	options.function = args["function"];
+
+	const char* strings = args["strings"];
+	options.string_detect = StringDetectType::NONE;
+	if( strings && strings == "aggressive"s )
+		options.string_detect = StringDetectType::AGGRESSIVE;
+	else if( strings && strings == "comment"s )
+		options.string_detect = StringDetectType::COMMENT;
+
+	if( const char* max_ms = args["max-ms"] )
+		options.max_function_ms = atof( max_ms );
+	if( const char* max_mb = args["max-mb"] )
+		options.max_function_bytes = (size_t)( atof( max_mb ) * 1024 * 1024 );
+
+	if( const char* jobs = args["jobs"] )
+		options.num_threads = std::max( 1, atoi( jobs ) );
+
+	const char* format = args["format"];
+	options.format = OutputFormat::TEXT;
+	if( format && format == "ndjson"s )
+		options.format = OutputFormat::NDJSON;
+
+	return options;
+}
+
+// The file arguments, with directories replaced by the .smx files in them
+static std::vector<std::string> CollectFiles( const OptParse& args )
+{
+	std::vector<std::string> files;
+	for( size_t i = 0; i < args.GetArgC(); i++ )
+	{
+		std::string path = args.GetArg( (int)i );
+		if( !std::filesystem::is_directory( path ) )
+		{
+			files.push_back( path );
+			continue;
+		}
+
+		size_t first = files.size();
+		for( const auto& entry : std::filesystem::recursive_directory_iterator( path ) )
+		{
+			if( entry.is_regular_file() && entry.path().extension() == ".smx" )
+				files.push_back( entry.path().string() );
+		}
+		std::sort( files.begin() + first, files.end() );
+	}
+	return files;
+}
+
+static int BuildIndex( const OptParse& args )
+{
+	std::vector<std::string> files = CollectFiles( args );
+
+	unsigned int num_threads = std::max( 1u, std::thread::hardware_concurrency() );
+	if( !CorpusIndex::Build( files, args["index"], num_threads ) )
+	{
+		std::cout << "Could not write index " << args["index"] << std::endl;
+		return 1;
+	}
+
+	std::cout << "Indexed " << files.size() << " files" << std::endl;
+	return 0;
+}
+
+static int BuildFingerprints( const OptParse& args )
+{
+	FingerprintDb db;
+	std::vector<std::string> files = CollectFiles( args );
+	for( const std::string& path : files )
+	{
+		SmxFile smx( path.c_str() );
+		if( smx.code_size() != 0 )
+			db.AddFile( smx );
+	}
+
+	if( !db.Save( args["build-fingerprints"] ) )
+	{
+		std::cout << "Could not write fingerprints " << args["build-fingerprints"] << std::endl;
+		return 1;
+	}
+
+	std::cout << "Fingerprinted " << db.size() << " functions from " << files.size() << " files" << std::endl;
+	return 0;
+}
+
+static int RunBatch( const OptParse& args, const char* self )
+{
+	// Workers get the same decompiler options as the supervisor
+	std::vector<std::string> worker_args;
+	for( const char* option : { "strings", "max-ms", "max-mb", "skip-known", "name-known" } )
+	{
+		if( args[option] )
+		{
+			worker_args.push_back( "--"s + option );
+			worker_args.push_back( args[option] );
+		}
+	}
+
+	// A worker stuck on a function for longer than this is killed and the function skipped
+	double timeout_s = 60.0;
+	if( const char* timeout = args["timeout"] )
+		timeout_s = std::max( 0.0, atof( timeout ) );
+
+	std::vector<std::string> files = CollectFiles( args );
+	BatchSupervisor supervisor( self, worker_args, args["batch"], (unsigned int)( timeout_s * 1000 ) );
+	unsigned int num_workers = std::max( 1u, std::thread::hardware_concurrency() );
+	if( !supervisor.Run( files, num_workers ) )
+	{
+		std::cout << "Could not write journal in " << args["batch"] << std::endl;
+		return 1;
+	}
+
+	std::cout << "Decompiled " << files.size() - supervisor.num_skipped_files() << " files ("
+		<< supervisor.num_skipped_files() << " already done), "
+		<< supervisor.num_failed_functions() << " functions failed" << std::endl;
+	return 0;
+}
+
+static int RunBatchWorker( const OptParse& args, const DecompilerOptions& options )
+{
+	std::set<cell_t> skip;
+	if( const char* list = args["skip"] )
+	{
+		// Comma separated function starts
+		for( const char* p = list; *p; p++ )
+		{
+			char* end;
+			skip.insert( (cell_t)strtol( p, &end, 10 ) );
+			p = end;
+			if( *p != ',' )
+				break;
+		}
+	}
+
+	cell_t after = args["after"] ? (cell_t)atoi( args["after"] ) : -1;
+	return BatchSupervisor::RunWorker( args["batch-worker"], args["out"], after, skip, options );
+}
+
+static int RunQuery( const OptParse& args, const DecompilerOptions& options )
+{
+	CorpusIndex index;
+	if( !index.Load( args["query"] ) )
+	{
+		std::cout << "Could not read index " << args["query"] << std::endl;
+		return 1;
+	}
+
+	CorpusIndex::Query query;
+	query.function = args["function"];
+	query.native = args["native"];
+	query.string = args["string"];
+	query.hash = args["hash"];
+	std::vector<CorpusIndex::Posting> matches = index.Run( query );
+
+	// Matches are grouped by file, so each file only needs to be loaded once to decompile them
+	std::unique_ptr<SmxFile> smx;
+	std::unique_ptr<Decompiler> decompiler;
+	for( size_t i = 0; i < matches.size(); i++ )
+	{
+		const CorpusIndex::Posting& match = matches[i];
+		const char* name = index.FunctionName( match.file, match.func );
+
+		std::string code;
+		if( args["decompile"] )
+		{
+			if( i == 0 || matches[i - 1].file != match.file )
+			{
+				smx = std::make_unique<SmxFile>( index.file( match.file ) );
+				decompiler = std::make_unique<Decompiler>( *smx, options );
+			}
+
+			SmxFunction* func = smx->FindFunctionAt( match.func );
+			if( !func )
+			{
+				smx->AddFunction( match.func );
+				func = smx->FindFunctionAt( match.func );
+			}
+			if( smx->code_size() != 0 && func )
+				code = decompiler->Decompile( *func ).code;
+		}
+
+		if( options.format == OutputFormat::NDJSON )
+		{
+			JsonWriter json;
+			json.BeginObject()
+				.Key( "file" ).String( index.file( match.file ) )
+				.Key( "function" ).String( name )
+				.Key( "start" ).Number( (int64_t)match.func );
+			if( args["decompile"] )
+				json.Key( "code" ).String( code );
+			json.EndObject();
+			std::cout << json.str() << '\n';
+		}
+		else
+		{
+			std::cout << index.file( match.file ) << ": " << ( name ? name : "?" ) << '\n';
+			if( args["decompile"] )
+				std::cout << code << '\n';
+		}
+	}
+	std::cout.flush();
+	return 0;
+}
+
 int main( int argc, const char* argv[] )
 {
 	OptParse args;
@@ -13,14 +235,116 @@ int main( int argc, const char* argv[] )
 		.AddArgOption( "strings", 's' )
 		.AddFlagOption( "no-globals", 'g' )
 		.AddFlagOption( "assembly", 'a' )
-		.AddFlagOption( "il", 'i' );
+		.AddFlagOption( "il", 'i' )
+		.AddArgOption( "format", "text" )
+		.AddFlagOption( "xrefs", 'x' )
+		.AddArgOption( "index" )
+		.AddArgOption( "query" )
+		.AddArgOption( "native" )
+		.AddArgOption( "string" )
+		.AddArgOption( "hash" )
+		.AddFlagOption( "decompile", 'd' )
+		.AddArgOption( "build-fingerprints" )
+		.AddArgOption( "skip-known" )
+		.AddArgOption( "name-known" )
+		.AddFlagOption( "diff" )
+		.AddArgOption( "max-ms" )
+		.AddArgOption( "max-mb" )
+		.AddArgOption( "jobs", 'j' )
+		.AddArgOption( "trace" )
+		.AddArgOption( "batch" )
+		.AddArgOption( "batch-worker" )
+		.AddArgOption( "timeout" )
+		.AddArgOption( "out" )
+		.AddArgOption( "after" )
+		.AddArgOption( "skip" )
+		.AddFlagOption( "server" );
 	args.Process( argc, argv );
 
+	// Written when main returns, after everything declared below is gone and all threads are done
+	struct TraceWriter
+	{
+		const char* path;
+		~TraceWriter()
+		{
+			if( path && !Trace::Write( path ) )
+				std::cout << "Could not write trace " << path << std::endl;
+		}
+	} trace_writer{ args["trace"] };
+	if( trace_writer.path )
+		Trace::Start();
+
+	if( args["index"] && args.GetArgC() >= 1 )
+		return BuildIndex( args );
+	if( args["build-fingerprints"] && args.GetArgC() >= 1 )
+		return BuildFingerprints( args );
+
+	// Kept alive for as long as anything decompiles with it
+	FingerprintDb known_functions;
+	const char* known_path = args["skip-known"] ? args["skip-known"] : args["name-known"];
+	if( known_path && !known_functions.Load( known_path ) )
+	{
+		std::cout << "Could not read fingerprints " << known_path << std::endl;
+		return 1;
+	}
+
+	auto ParseOptions = [&]() {
+		DecompilerOptions options = ParseDecompilerOptions( args );
+		if( known_path )
+		{
+			options.known_mode = args["skip-known"] ? KnownFunctionMode::SKIP : KnownFunctionMode::NAME;
+			options.known_functions = &known_functions;
+		}
+		return options;
+	};
+
+	if( args["query"] )
+		return RunQuery( args, ParseOptions() );
+	if( args["batch"] && args.GetArgC() >= 1 )
+		return RunBatch( args, argv[0] );
+	if( args["batch-worker"] && args["out"] )
+		return RunBatchWorker( args, ParseOptions() );
+
+	if( args["server"] )
+	{
+		DecompilerOptions options = ParseOptions();
+		DecompilerServer server( options );
+		server.Run( std::cin, std::cout );
+		return 0;
+	}
+
+	if( args["diff"] && args.GetArgC() >= 2 )
+	{
+		for( int i = 0; i < 2; i++ )
+		{
+			if( !std::filesystem::exists( args.GetArg( i ) ) )
+			{
+				std::cout << "Could not open file " << args.GetArg( i ) << std::endl;
+				return 1;
+			}
+		}
+
+		SmxFile old_smx( args.GetArg( 0 ).c_str() );
+		SmxFile new_smx( args.GetArg( 1 ).c_str() );
+		PluginDiff diff( old_smx, new_smx );
+		diff.Print( ParseOptions() );
+		return 0;
+	}
+
 	if( args.GetArgC() < 1 )
 	{
 		std::cout << "Usage: "
 			<< argv[0]
-			<< " [--function/-f <function>] [--no-globals/-g] [--assembly/-a] [--il/-i] <filename>\n";
+			<< " [--function/-f <function>] [--no-globals/-g] [--assembly/-a] [--il/-i] [--jobs/-j <threads>] [--format=<text/ndjson>] <filename>\n"
+			<< "       " << argv[0] << " --xrefs/-x [--format=<text/ndjson>] <filename>\n"
+			<< "       " << argv[0] << " --diff [--format=<text/ndjson>] <old file> <new file>\n"
+			<< "       " << argv[0] << " --index <index> <files/directories...>\n"
+			<< "       " << argv[0] << " --query <index> [--function/-f <name>] [--native <name>] [--string <text>] [--hash <hash>] [--decompile/-d] [--format=<text/ndjson>]\n"
+			<< "       " << argv[0] << " --batch <output directory> [--timeout <seconds>] <files/directories...>\n"
+			<< "       " << argv[0] << " --build-fingerprints <db> <files/directories...>\n"
+			<< "       " << argv[0] << " --server (JSON requests on stdin, responses on stdout)\n"
+			<< "Any mode that decompiles also takes --skip-known <db> or --name-known <db>, and --max-ms <ms> and --max-mb <MB> to limit each function\n"
+			<< "Any mode also takes --trace <file> to write a Chrome trace of where the time went\n";
 		return 1;
 	}
 
@@ -32,17 +356,13 @@ int main( int argc, const char* argv[] )
 
 	SmxFile smx( args.GetArg( 0 ).c_str() );
 	
-	DecompilerOptions options;
-	options.print_globals = !args["no-globals"];
-	options.print_il = args["il"];
-	options.print_assembly = args["assembly"];
-	options.function = args["function"];
-
-	options.string_detect = StringDetectType::NONE;
-	if( args["strings"] == "aggressive"s )
-		options.string_detect = StringDetectType::AGGRESSIVE;
-	else if( args["strings"] == "comment"s )
-		options.string_detect = StringDetectType::COMMENT;
+	DecompilerOptions options = ParseOptions();
+	if( args["xrefs"] )
+	{
+		XrefIndex xrefs( smx );
+		xrefs.Print( options.format );
+		return 0;
+	}
 
 	Decompiler decompiler( smx, options );
 	decompiler.Print();
@@ -85,6 +85,24 @@ private:
 	int ProcessLongOption( int index, int argc, const char** argv )
 	{
 		std::string option = &argv[index][2]; // get the option without the -- at the start
+
+		// Arguments can also be given as --option=value
+		size_t equals = option.find( '=' );
+		if( equals != std::string::npos )
+		{
+			std::string value = option.substr( equals + 1 );
+			option.erase( equals );
+			for( const Option& o : options )
+			{
+				if( o.longname == option && o.has_argument )
+				{
+					option_args[option] = value;
+					break;
+				}
+			}
+			return index;
+		}
+
 		for( const Option& o : options )
 		{
 			if( o.longname == option )
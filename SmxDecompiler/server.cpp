@@ -0,0 +1,278 @@
+#include "server.h"
+
+#include <filesystem>
+#include <cstring>
+
+DecompilerServer::DecompilerServer( const DecompilerOptions& options ) :
+	options_( options )
+{
+	// Output is only ever requested per function, IL is kept alongside the code as it comes for free
+	options_.function = nullptr;
+	options_.print_globals = false;
+	options_.print_assembly = false;
+	options_.print_il = true;
+}
+
+void DecompilerServer::Run( std::istream& in, std::ostream& out )
+{
+	std::string line;
+	while( !shutdown_ && std::getline( in, line ) )
+	{
+		if( line.find_first_not_of( " \t\r" ) == std::string::npos )
+			continue;
+
+		JsonWriter response;
+		response.BeginObject();
+
+		JsonValue request;
+		if( !JsonValue::Parse( line, request ) || request.type() != JsonValue::Type::OBJECT )
+		{
+			response.Key( "id" ).Null();
+			response.Key( "error" ).String( "invalid request" );
+		}
+		else
+		{
+			response.Key( "id" );
+			const JsonValue* id = request.Find( "id" );
+			if( id && id->type() == JsonValue::Type::NUMBER )
+				response.Number( (int64_t)id->AsNumber() );
+			else if( id && id->type() == JsonValue::Type::STRING )
+				response.String( id->AsString() );
+			else
+				response.Null();
+
+			JsonWriter result;
+			std::string error;
+			if( HandleRequest( request, result, error ) )
+				response.Key( "result" ).Raw( result.str().empty() ? "null" : result.str() );
+			else
+				response.Key( "error" ).String( error );
+		}
+
+		response.EndObject();
+
+		// Flush every response so clients can pipeline requests and read results as they come
+		out << response.str() << '\n';
+		out.flush();
+	}
+}
+
+bool DecompilerServer::HandleRequest( const JsonValue& request, JsonWriter& result, std::string& error )
+{
+	const char* method = request.Find( "method" ) ? request.Find( "method" )->AsString() : nullptr;
+	if( !method )
+	{
+		error = "missing method";
+		return false;
+	}
+
+	static const JsonValue no_params;
+	const JsonValue* params = request.Find( "params" );
+	if( !params )
+		params = &no_params;
+
+	if( strcmp( method, "open" ) == 0 )
+		return Open( *params, result, error );
+	if( strcmp( method, "close" ) == 0 )
+		return Close( *params, result, error );
+	if( strcmp( method, "functions" ) == 0 )
+		return ListFunctions( *params, result, error );
+	if( strcmp( method, "decompile" ) == 0 || strcmp( method, "disassemble" ) == 0 || strcmp( method, "il" ) == 0 )
+		return GetFunctionText( method, *params, result, error );
+	if( strcmp( method, "xrefs" ) == 0 )
+		return GetXrefs( *params, result, error );
+	if( strcmp( method, "shutdown" ) == 0 )
+	{
+		shutdown_ = true;
+		return true;
+	}
+
+	error = std::string( "unknown method " ) + method;
+	return false;
+}
+
+bool DecompilerServer::Open( const JsonValue& params, JsonWriter& result, std::string& error )
+{
+	const char* filename = params.Find( "file" ) ? params.Find( "file" )->AsString() : nullptr;
+	if( !filename )
+	{
+		error = "missing file";
+		return false;
+	}
+
+	auto& file = files_[filename];
+	if( !file )
+	{
+		if( !std::filesystem::exists( filename ) )
+		{
+			files_.erase( filename );
+			error = std::string( "could not open file " ) + filename;
+			return false;
+		}
+
+		auto loaded = std::make_unique<LoadedFile>();
+		loaded->smx = std::make_unique<SmxFile>( filename );
+		if( loaded->smx->code_size() == 0 )
+		{
+			files_.erase( filename );
+			error = std::string( "not a valid smx file " ) + filename;
+			return false;
+		}
+		loaded->decompiler = std::make_unique<Decompiler>( *loaded->smx, options_ );
+		file = std::move( loaded );
+	}
+
+	result.BeginObject()
+		.Key( "file" ).String( filename )
+		.Key( "num_functions" ).Number( (int64_t)file->smx->num_functions() )
+		.EndObject();
+	return true;
+}
+
+bool DecompilerServer::Close( const JsonValue& params, JsonWriter& /*result*/, std::string& error )
+{
+	if( !FindFile( params, error ) )
+		return false;
+
+	files_.erase( params.Find( "file" )->AsString() );
+	return true;
+}
+
+bool DecompilerServer::ListFunctions( const JsonValue& params, JsonWriter& result, std::string& error )
+{
+	LoadedFile* file = FindFile( params, error );
+	if( !file )
+		return false;
+
+	result.BeginArray();
+	for( size_t i = 0; i < file->smx->num_functions(); i++ )
+	{
+		const SmxFunction& func = file->smx->function( i );
+		result.BeginObject()
+			.Key( "name" ).String( func.name )
+			.Key( "start" ).Number( (int64_t)func.pcode_start )
+			.Key( "end" ).Number( (int64_t)func.pcode_end )
+			.Key( "public" ).Bool( func.is_public )
+			.EndObject();
+	}
+	result.EndArray();
+	return true;
+}
+
+bool DecompilerServer::GetFunctionText( const char* method, const JsonValue& params, JsonWriter& result, std::string& error )
+{
+	LoadedFile* file = FindFile( params, error );
+	if( !file )
+		return false;
+	SmxFunction* func = FindFunction( *file, params, error );
+	if( !func )
+		return false;
+
+	if( strcmp( method, "disassemble" ) == 0 )
+	{
+		FunctionCache& cache = file->functions[func->pcode_start];
+		if( !cache.has_disasm )
+		{
+			cache.disasm = file->decompiler->Disassemble( *func );
+			cache.has_disasm = true;
+		}
+		result.String( cache.disasm );
+		return true;
+	}
+
+	FunctionCache& cache = Decompile( *file, *func );
+	result.String( strcmp( method, "il" ) == 0 ? cache.il : cache.code );
+	return true;
+}
+
+bool DecompilerServer::GetXrefs( const JsonValue& params, JsonWriter& result, std::string& error )
+{
+	LoadedFile* file = FindFile( params, error );
+	if( !file )
+		return false;
+	SmxFunction* func = FindFunction( *file, params, error );
+	if( !func )
+		return false;
+
+	if( !file->xrefs )
+		file->xrefs = std::make_unique<XrefIndex>( *file->smx );
+
+	result.BeginObject().Key( "callers" ).BeginArray();
+	XrefIndex::Range callers = file->xrefs->To( XrefIndex::Kind::CALL, func->pcode_start );
+	for( const XrefIndex::Xref* xref = callers.first; xref != callers.second; xref++ )
+	{
+		SmxFunction* caller = file->smx->FindFunctionAt( xref->addr );
+		result.BeginObject()
+			.Key( "address" ).Number( (int64_t)xref->addr )
+			.Key( "function" ).String( caller ? caller->name : nullptr )
+			.EndObject();
+	}
+	result.EndArray();
+
+	result.Key( "callees" ).BeginArray();
+	XrefIndex::Range refs = file->xrefs->From( func->pcode_start );
+	for( const XrefIndex::Xref* xref = refs.first; xref != refs.second; xref++ )
+	{
+		if( xref->kind != XrefIndex::Kind::CALL )
+			continue;
+
+		SmxFunction* callee = file->smx->FindFunctionAt( xref->target );
+		result.BeginObject()
+			.Key( "address" ).Number( (int64_t)xref->addr )
+			.Key( "function" ).String( callee ? callee->name : nullptr )
+			.EndObject();
+	}
+	result.EndArray().EndObject();
+	return true;
+}
+
+DecompilerServer::LoadedFile* DecompilerServer::FindFile( const JsonValue& params, std::string& error )
+{
+	const char* filename = params.Find( "file" ) ? params.Find( "file" )->AsString() : nullptr;
+	if( !filename )
+	{
+		error = "missing file";
+		return nullptr;
+	}
+
+	auto it = files_.find( filename );
+	if( it == files_.end() )
+	{
+		error = std::string( "file not open " ) + filename;
+		return nullptr;
+	}
+	return it->second.get();
+}
+
+SmxFunction* DecompilerServer::FindFunction( LoadedFile& file, const JsonValue& params, std::string& error )
+{
+	// Functions can be given either by name or by address
+	SmxFunction* func = nullptr;
+	const JsonValue* param = params.Find( "function" );
+	if( param && param->type() == JsonValue::Type::STRING )
+		func = file.smx->FindFunctionByName( param->AsString() );
+	else if( param && param->type() == JsonValue::Type::NUMBER )
+		func = file.smx->FindFunctionAt( (cell_t)param->AsNumber() );
+	else
+	{
+		error = "missing function";
+		return nullptr;
+	}
+
+	if( !func )
+		error = "function not found";
+	return func;
+}
+
+DecompilerServer::FunctionCache& DecompilerServer::Decompile( LoadedFile& file, SmxFunction& func )
+{
+	FunctionCache& cache = file.functions[func.pcode_start];
+	if( cache.has_code )
+		return cache;
+
+	DecompiledFunction result = file.decompiler->Decompile( func );
+	cache.il = std::move( result.il );
+	cache.code = std::move( result.code );
+	cache.has_code = true;
+	return cache;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "smx-file.h"
+#include "decompiler.h"
+#include "json.h"
+#include "xrefs.h"
+
+// Long-running mode that keeps loaded files, their xref index and the text produced for each function
+// resident. Lifted graphs aren't kept, building the code consumes them and only text is ever returned.
+// Requests are newline-delimited JSON objects of the form
+//   {"id": 1, "method": "decompile", "params": {"file": "plugin.smx", "function": "OnPluginStart"}}
+// and each gets a single line response of either {"id": 1, "result": ...} or {"id": 1, "error": "..."}
+class DecompilerServer
+{
+public:
+	DecompilerServer( const DecompilerOptions& options );
+
+	// Handles requests until the input is closed or a "shutdown" request is received
+	void Run( std::istream& in, std::ostream& out );
+private:
+	struct FunctionCache
+	{
+		bool has_disasm = false;
+		bool has_code = false;
+		std::string disasm;
+		std::string il;
+		std::string code;
+	};
+
+	struct LoadedFile
+	{
+		std::unique_ptr<SmxFile> smx;
+		std::unique_ptr<Decompiler> decompiler;
+		std::unordered_map<cell_t, FunctionCache> functions; // Keyed by pcode_start
+		std::unique_ptr<XrefIndex> xrefs; // Built on the first xrefs request
+	};
+
+	bool HandleRequest( const JsonValue& request, JsonWriter& result, std::string& error );
+
+	bool Open( const JsonValue& params, JsonWriter& result, std::string& error );
+	bool Close( const JsonValue& params, JsonWriter& result, std::string& error );
+	bool ListFunctions( const JsonValue& params, JsonWriter& result, std::string& error );
+	bool GetFunctionText( const char* method, const JsonValue& params, JsonWriter& result, std::string& error );
+	bool GetXrefs( const JsonValue& params, JsonWriter& result, std::string& error );
+
+	LoadedFile* FindFile( const JsonValue& params, std::string& error );
+	SmxFunction* FindFunction( LoadedFile& file, const JsonValue& params, std::string& error );
+	FunctionCache& Decompile( LoadedFile& file, SmxFunction& func );
+private:
+	DecompilerOptions options_;
+	std::unordered_map<std::string, std::unique_ptr<LoadedFile>> files_;
+	bool shutdown_ = false;
+};
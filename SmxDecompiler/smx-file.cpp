@@ -2,9 +2,22 @@
 
 #include <fstream>
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
+#include "trace.h"
 #include "third_party/zlib/zlib.h"
 
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define SMX_USE_SSE2
+#endif
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
 struct SmxConsts {
     static const uint32_t FILE_MAGIC = 0x53504646;
 
@@ -177,6 +190,18 @@ static const uint8_t kVarClass_Arg = 0x3;
 #    pragma pack(pop)
 #endif
 
+template <typename Row>
+static const Row* GetRttiRow( const char* table, size_t index )
+{
+    auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>( table );
+    return reinterpret_cast<const Row*>( table + rttihdr->header_size + index * rttihdr->row_size );
+}
+
+static size_t GetRttiRowCount( const char* table )
+{
+    return reinterpret_cast<const smx_rtti_table_header*>( table )->row_count;
+}
+
 SmxFile::SmxFile( const char* filename )
 {
     std::ifstream file( filename, std::ios::binary );
@@ -237,6 +262,8 @@ SmxFile::SmxFile( const char* filename )
 
 SmxFunction* SmxFile::FindFunctionByName( const char* func_name )
 {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+
     for( SmxFunction& func : functions_ )
     {
         if( func.name && strcmp( func.name, func_name ) == 0 )
@@ -249,18 +276,22 @@ SmxFunction* SmxFile::FindFunctionByName( const char* func_name )
 
 SmxFunction* SmxFile::FindFunctionAt( cell_t addr )
 {
-    for( SmxFunction& func : functions_ )
-    {
-        if( addr >= func.pcode_start && addr < func.pcode_end )
-        {
-            return &func;
-        }
-    }
-    return nullptr;
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+
+    // Functions don't overlap, so only the last one starting at or before addr can contain it
+    auto it = function_index_.upper_bound( addr );
+    if( it == function_index_.begin() )
+        return nullptr;
+    SmxFunction* func = std::prev( it )->second;
+    if( addr >= func->pcode_end )
+        return nullptr;
+    return func;
 }
 
 SmxFunction* SmxFile::FindFunctionById( cell_t id )
 {
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+
     if( id & 1 )
     {
         id >>= 1;
@@ -282,6 +313,8 @@ SmxNative* SmxFile::FindNativeByIndex( size_t index )
 
 SmxVariable* SmxFile::FindGlobalByName( const char* var_name )
 {
+    LoadSection( dbg_globals_section_ );
+
     for( SmxVariable& var : globals_ )
     {
         if( strcmp( var.name, var_name ) == 0 )
@@ -294,14 +327,12 @@ SmxVariable* SmxFile::FindGlobalByName( const char* var_name )
 
 SmxVariable* SmxFile::FindGlobalAt( cell_t addr )
 {
-    for( SmxVariable& var : globals_ )
-    {
-        if( var.address == addr )
-        {
-            return &var;
-        }
-    }
-    return nullptr;
+    LoadSection( dbg_globals_section_ );
+
+    auto it = global_index_.find( addr );
+    if( it == global_index_.end() )
+        return nullptr;
+    return &globals_[it->second];
 }
 
 SmxSection* SmxFile::GetSectionByName( const char* name )
@@ -319,10 +350,12 @@ SmxSection* SmxFile::GetSectionByName( const char* name )
 #define READ_SECTION( sec_name, handler ) \
     do { \
         SmxSection* section = GetSectionByName( sec_name ); \
-        if( section ) handler( section->name, section->offset, section->size ); \
+        if( section ) { TraceSpan span( "ReadSection", section->name ); handler( section->name, section->offset, section->size ); } \
     } while( false )
 void SmxFile::ReadSections()
 {
+    // Only the sections needed to enumerate functions are read up front. The remaining
+    // rtti/dbg tables are read by LoadSection once something first needs them.
     READ_SECTION( ".code",                  ReadCode );
     READ_SECTION( ".data",                  ReadData );
     READ_SECTION( ".names",                 ReadNames );
@@ -330,22 +363,30 @@ void SmxFile::ReadSections()
     READ_SECTION( ".pubvars",               ReadPubvars );
     READ_SECTION( ".natives",               ReadNatives );
     READ_SECTION( "rtti.data",              ReadRttiData );
-    READ_SECTION( "rtti.enums",             ReadRttiEnums );
-    READ_SECTION( "rtti.typedefs",          ReadRttiTypeDefs );
-    READ_SECTION( "rtti.typesets",          ReadRttiTypeSets );
-    READ_SECTION( "rtti.fields",            ReadRttiFields );
-    READ_SECTION( "rtti.classdefs",         ReadRttiClassdefs );
-    READ_SECTION( "rtti.enumstruct_fields", ReadRttiEnumStructFields );
-    READ_SECTION( "rtti.enumstructs",       ReadRttiEnumStructs );
     READ_SECTION( "rtti.methods",           ReadRttiMethods );
-    READ_SECTION( "rtti.natives",           ReadRttiNatives );
-    READ_SECTION( ".dbg.globals",           ReadDbgGlobals );
-    READ_SECTION( ".dbg.locals",            ReadDbgLocals );
-    READ_SECTION( ".dbg.methods",           ReadDbgMethods );
     // TODO: Also read legacy debug sections (.dbg.symbols, .dbg.natives)
 }
 #undef READ_SECTION
 
+void SmxFile::ReadLazySection( LazySection& lazy )
+{
+    // Checked again under the lock, another thread may have loaded it in the meantime. Loading is
+    // marked before reading, tables can reference each other (e.g. a classdef field whose type is
+    // another classdef) and will re-enter here while being read
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    if( lazy.loaded.load( std::memory_order_relaxed ) || lazy.loading )
+        return;
+    lazy.loading = true;
+
+    SmxSection* section = GetSectionByName( lazy.name );
+    if( section )
+    {
+        TraceSpan span( "ReadSection", section->name );
+        (this->*lazy.reader)( section->name, section->offset, section->size );
+    }
+    lazy.loaded.store( true, std::memory_order_release );
+}
+
 void SmxFile::ReadCode( const char* name, size_t offset, size_t size )
 {
     auto* codehdr = reinterpret_cast<const sp_file_code_t*>(image_.get() + offset);
@@ -360,6 +401,125 @@ void SmxFile::ReadData( const char* name, size_t offset, size_t size )
     data_size_ = datahdr->datasize;
 }
 
+// Builds the NUL and control character bitmaps for 64 bytes of data, 64 bytes past data must be readable
+static void ClassifyBytes( const char* data, uint64_t& nul, uint64_t& control )
+{
+#if defined( __AVX2__ )
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_control = _mm256_set1_epi8( 0x1f );
+    nul = 0;
+    control = 0;
+    for( int i = 0; i < 64; i += 32 )
+    {
+        __m256i bytes = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data + i ) );
+        // Unsigned x <= 0x1f is the same as min( x, 0x1f ) == x
+        uint32_t nul_mask = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( bytes, zero ) );
+        uint32_t control_mask = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_min_epu8( bytes, max_control ), bytes ) );
+        nul |= (uint64_t)nul_mask << i;
+        control |= (uint64_t)control_mask << i;
+    }
+#elif defined( SMX_USE_SSE2 )
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max_control = _mm_set1_epi8( 0x1f );
+    nul = 0;
+    control = 0;
+    for( int i = 0; i < 64; i += 16 )
+    {
+        __m128i bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) );
+        // Unsigned x <= 0x1f is the same as min( x, 0x1f ) == x
+        uint32_t nul_mask = (uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8( bytes, zero ) );
+        uint32_t control_mask = (uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_min_epu8( bytes, max_control ), bytes ) );
+        nul |= (uint64_t)nul_mask << i;
+        control |= (uint64_t)control_mask << i;
+    }
+#else
+    nul = 0;
+    control = 0;
+    for( int i = 0; i < 64; i++ )
+    {
+        unsigned char c = (unsigned char)data[i];
+        nul |= (uint64_t)(c == 0) << i;
+        control |= (uint64_t)(c < 0x20) << i;
+    }
+#endif
+}
+
+static int CountTrailingZeros( uint64_t val )
+{
+#if defined( _MSC_VER )
+    unsigned long index;
+    _BitScanForward64( &index, val );
+    return (int)index;
+#else
+    return __builtin_ctzll( val );
+#endif
+}
+
+void SmxFile::ReadDataStrings( const char* name, size_t offset, size_t size )
+{
+    size_t num_words = (data_size_ + 63) / 64;
+    nul_bits_.resize( num_words );
+    control_bits_.resize( num_words );
+    string_start_bits_.resize( num_words );
+
+    // Last partial word is classified from a padded copy so nothing past .data is read. Bytes
+    // past the end count as NUL, so strings running into the end are cut off there
+    size_t full_words = data_size_ / 64;
+    for( size_t i = 0; i < full_words; i++ )
+        ClassifyBytes( data_ + i * 64, nul_bits_[i], control_bits_[i] );
+    if( full_words != num_words )
+    {
+        char tail[64] = {};
+        memcpy( tail, data_ + full_words * 64, data_size_ - full_words * 64 );
+        ClassifyBytes( tail, nul_bits_[full_words], control_bits_[full_words] );
+    }
+
+    // A start is a non-NUL byte whose previous byte is NUL. Nothing comes before the first byte
+    uint64_t carry = 0;
+    for( size_t i = 0; i < num_words; i++ )
+    {
+        string_start_bits_[i] = ~nul_bits_[i] & ((nul_bits_[i] << 1) | carry);
+        carry = nul_bits_[i] >> 63;
+    }
+}
+
+size_t SmxFile::FindNextBit( const std::vector<uint64_t>& bits, size_t index, size_t end )
+{
+    if( index >= end )
+        return end;
+
+    size_t word = index / 64;
+    uint64_t val = bits[word] & (~0ULL << (index % 64));
+    while( val == 0 )
+    {
+        if( ++word >= bits.size() )
+            return end;
+        val = bits[word];
+    }
+
+    size_t found = word * 64 + CountTrailingZeros( val );
+    return found < end ? found : end;
+}
+
+size_t SmxFile::StringLength( cell_t addr )
+{
+    LoadSection( data_strings_section_ );
+    if( (size_t)addr >= data_size_ )
+        return 0;
+
+    return FindNextBit( nul_bits_, addr, data_size_ ) - addr;
+}
+
+bool SmxFile::IsPrintableString( cell_t addr )
+{
+    LoadSection( data_strings_section_ );
+    if( (size_t)addr >= data_size_ )
+        return true;
+
+    // The first control character has to be the terminating NUL
+    return FindNextBit( control_bits_, addr, data_size_ ) == FindNextBit( nul_bits_, addr, data_size_ );
+}
+
 void SmxFile::ReadNames( const char* name, size_t offset, size_t size )
 {
     names_ = image_.get() + offset;
@@ -367,10 +527,17 @@ void SmxFile::ReadNames( const char* name, size_t offset, size_t size )
 
 void SmxFile::AddFunction( cell_t addr )
 {
-    SmxFunction func;
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+
+    // Another thread may have discovered the same function first
+    if( FindFunctionAt( addr ) )
+        return;
+
+    SmxFunction& func = functions_.emplace_back();
+    func.smx_ = this;
     func.pcode_start = addr;
     func.pcode_end = addr + 1;
-    functions_.push_back( func );
+    function_index_.emplace( addr, &func );
 }
 
 void SmxFile::ReadPublics( const char* name, size_t offset, size_t size )
@@ -379,12 +546,14 @@ void SmxFile::ReadPublics( const char* name, size_t offset, size_t size )
     size_t row_count = size / sizeof( sp_file_publics_t );
     for( size_t i = 0; i < row_count; i++ )
     {
-        SmxFunction func;
+        SmxFunction& func = functions_.emplace_back();
+        func.smx_ = this;
         func.raw_name = names_ + rows[i].name;
         func.name = func.raw_name;
         func.pcode_start = rows[i].address;
         // No pcode_end for the .publics section
         func.pcode_end = func.pcode_start + 1;
+        function_index_.emplace( func.pcode_start, &func );
 
         // Public functions have just their name
         // Non-public functions are prefixed with `.<address>.`
@@ -398,8 +567,6 @@ void SmxFile::ReadPublics( const char* name, size_t offset, size_t size )
             func.name++;
             func.is_public = false;
         }
-
-        functions_.push_back( func );
     }
 }
 
@@ -427,6 +594,7 @@ void SmxFile::ReadPubvars( const char* name, size_t offset, size_t size )
             global.is_public = false;
         }
 
+        global_index_.emplace( global.address, globals_.size() );
         globals_.push_back( global );
     }
 }
@@ -437,10 +605,10 @@ void SmxFile::ReadNatives( const char* name, size_t offset, size_t size )
     size_t row_count = size / sizeof( sp_file_natives_t );
     for( size_t i = 0; i < row_count; i++ )
     {
-        SmxNative native;
+        SmxNative& native = natives_.emplace_back();
+        native.smx_ = this;
+        native.index_ = i;
         native.name = names_ + rows[i].name;
-
-        natives_.push_back( native );
     }
 }
 
@@ -452,13 +620,16 @@ void SmxFile::ReadRttiData( const char* name, size_t offset, size_t size )
 void SmxFile::ReadRttiMethods( const char* name, size_t offset, size_t size )
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>(image_.get() + offset);
+    rtti_methods_ = image_.get() + offset;
 
-    rtti_methods_.reserve( rttihdr->row_count );
+    // Functions only have their start address at this point (from .publics), so join on that
+    // Only the function bounds are read here, signatures are decoded in LoadFunctionDebugInfo
     for( size_t i = 0; i < rttihdr->row_count; i++ )
     {
         auto* row = reinterpret_cast<const smx_rtti_method*>(image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size);
         
-        SmxFunction* func = FindFunctionAt( row->pcode_start );
+        auto it = function_index_.find( row->pcode_start );
+        SmxFunction* func = it != function_index_.end() ? it->second : nullptr;
         if( !func )
         {
             assert( !"Invalid rtti table" );
@@ -469,45 +640,28 @@ void SmxFile::ReadRttiMethods( const char* name, size_t offset, size_t size )
 
         func->name = names_ + row->name;
         func->pcode_end = row->pcode_end;
-        func->signature = DecodeFunctionSignature( row->signature );
-
-        rtti_methods_.push_back( func );
+        func->rtti_index_ = i;
     }
 }
 
 void SmxFile::ReadRttiNatives( const char* name, size_t offset, size_t size )
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>(image_.get() + offset);
+    assert( rttihdr->row_count == natives_.size() );
 
-    natives_.reserve( rttihdr->row_count );
-    for( size_t i = 0; i < rttihdr->row_count; i++ )
-    {
-        auto* row = reinterpret_cast<const smx_rtti_native*>(image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size);
-        
-        SmxNative* ntv = FindNativeByIndex( i );
-        if( !ntv )
-        {
-            assert( !"Invalid rtti table" );
-            break;
-        }
-        assert( strcmp( ntv->name, names_ + row->name ) == 0 );
-
-        ntv->name = names_ + row->name;
-        ntv->signature = DecodeFunctionSignature( row->signature );
-    }
+    // Signatures are decoded per native in LoadNativeSignature
+    rtti_natives_ = image_.get() + offset;
 }
 
 void SmxFile::ReadRttiEnums( const char* name, size_t offset, size_t size )
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>(image_.get() + offset);
 
-    enums_.reserve( rttihdr->row_count );
+    enums_.resize( rttihdr->row_count );
     for( size_t i = 0; i < rttihdr->row_count; i++ )
     {
         auto* row = reinterpret_cast<const smx_rtti_enum*>(image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size);
-        SmxEnum enm;
-        enm.name = names_ + row->name;
-        enums_.push_back( enm );
+        enums_[i].name = names_ + row->name;
     }
 }
 
@@ -515,13 +669,11 @@ void SmxFile::ReadRttiTypeDefs( const char* name, size_t offset, size_t size )
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>( image_.get() + offset );
 
-    typedefs_.reserve( rttihdr->row_count );
+    typedefs_.resize( rttihdr->row_count );
     for( size_t i = 0; i < rttihdr->row_count; i++ )
     {
         auto* row = reinterpret_cast<const smx_rtti_typedef*>( image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size );
-        SmxTypeDef td;
-        td.name = names_ + row->name;
-        typedefs_.push_back( td );
+        typedefs_[i].name = names_ + row->name;
     }
 }
 
@@ -529,13 +681,11 @@ void SmxFile::ReadRttiTypeSets( const char* name, size_t offset, size_t size )
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>( image_.get() + offset );
 
-    typesets_.reserve( rttihdr->row_count );
+    typesets_.resize( rttihdr->row_count );
     for( size_t i = 0; i < rttihdr->row_count; i++ )
     {
         auto* row = reinterpret_cast<const smx_rtti_typeset*>( image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size );
-        SmxTypeSet ts;
-        ts.name = names_ + row->name;
-        typesets_.push_back( std::move( ts ) );
+        typesets_[i].name = names_ + row->name;
     }
 }
 
@@ -543,11 +693,15 @@ void SmxFile::ReadRttiClassdefs( const char* name, size_t offset, size_t size )
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>(image_.get() + offset);
 
-    classdefs_.reserve( rttihdr->row_count );
+    // Sized up front so that pointers handed out while reading stay valid, including those taken
+    // by fields of this type that get decoded while loading the field table below
+    classdefs_.resize( rttihdr->row_count );
+
+    LoadSection( fields_section_ );
     for( size_t i = 0; i < rttihdr->row_count; i++ )
     {
         auto* row = reinterpret_cast<const smx_rtti_classdef*>(image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size);
-        SmxClassDef classdef;
+        SmxClassDef& classdef = classdefs_[i];
         classdef.flags = row->flags;
         classdef.name = names_ + row->name;
         if( i < rttihdr->row_count - 1 )
@@ -559,8 +713,7 @@ void SmxFile::ReadRttiClassdefs( const char* name, size_t offset, size_t size )
         {
             classdef.num_fields = fields_.size() - row->first_field;
         }
-        classdef.fields = &fields_[row->first_field];
-        classdefs_.push_back( classdef );
+        classdef.fields = fields_.data() + row->first_field;
     }
 }
 
@@ -568,14 +721,13 @@ void SmxFile::ReadRttiFields( const char* name, size_t offset, size_t size )
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>(image_.get() + offset);
 
-    fields_.reserve( rttihdr->row_count );
+    // Sized up front so that pointers handed out while reading stay valid
+    fields_.resize( rttihdr->row_count );
     for( size_t i = 0; i < rttihdr->row_count; i++ )
     {
         auto* row = reinterpret_cast<const smx_rtti_field*>(image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size);
-        SmxField field;
-        field.name = names_ + row->name;
-        field.type = DecodeVariableType( row->type_id );
-        fields_.push_back( field );
+        fields_[i].name = names_ + row->name;
+        fields_[i].type = DecodeVariableType( row->type_id );
     }
 }
 
@@ -583,11 +735,15 @@ void SmxFile::ReadRttiEnumStructs( const char* name, size_t offset, size_t size
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>( image_.get() + offset );
 
-    enum_structs_.reserve( rttihdr->row_count );
+    // Sized up front so that pointers handed out while reading stay valid, including those taken
+    // by fields of this type that get decoded while loading the field table below
+    enum_structs_.resize( rttihdr->row_count );
+
+    LoadSection( es_fields_section_ );
     for( size_t i = 0; i < rttihdr->row_count; i++ )
     {
         auto* row = reinterpret_cast<const smx_rtti_enumstruct*>( image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size );
-        SmxEnumStruct es;
+        SmxEnumStruct& es = enum_structs_[i];
         es.name = names_ + row->name;
         if( i < rttihdr->row_count - 1 )
         {
@@ -598,9 +754,8 @@ void SmxFile::ReadRttiEnumStructs( const char* name, size_t offset, size_t size
         {
             es.num_fields = es_fields_.size() - row->first_field;
         }
-        es.fields = &es_fields_[row->first_field];
+        es.fields = es_fields_.data() + row->first_field;
         es.size = row->size;
-        enum_structs_.push_back( es );
     }
 }
 
@@ -608,46 +763,34 @@ void SmxFile::ReadRttiEnumStructFields( const char* name, size_t offset, size_t
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>( image_.get() + offset );
 
-    es_fields_.reserve( rttihdr->row_count );
+    // Sized up front so that pointers handed out while reading stay valid
+    es_fields_.resize( rttihdr->row_count );
     for( size_t i = 0; i < rttihdr->row_count; i++ )
     {
         auto* row = reinterpret_cast<const smx_rtti_es_field*>( image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size );
-        SmxESField esf;
+        SmxESField& esf = es_fields_[i];
         esf.name = names_ + row->name;
         esf.type = DecodeVariableType( row->type_id );
         esf.offset = row->offset;
-        es_fields_.push_back( esf );
     }
 }
 
 void SmxFile::ReadDbgMethods( const char* name, size_t offset, size_t size )
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>( image_.get() + offset );
+    dbg_methods_ = image_.get() + offset;
 
+    // Only build the method -> row mapping, locals are decoded in LoadFunctionDebugInfo
+    dbg_method_rows_.resize( rtti_methods_ ? GetRttiRowCount( rtti_methods_ ) : 0, SmxFunction::NO_RTTI );
     for( size_t i = 0; i < rttihdr->row_count; i++ )
     {
         auto* row = reinterpret_cast<const smx_rtti_debug_method*>( image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size );
-        SmxFunction* func = rtti_methods_[row->method_index];
-        if( i != rttihdr->row_count - 1 )
-        {
-            auto* next_row = reinterpret_cast<const smx_rtti_debug_method*>( image_.get() + offset + rttihdr->header_size + (i + 1) * rttihdr->row_size );
-            func->num_locals = next_row->first_local - row->first_local;
-        }
-        else
+        if( row->method_index >= dbg_method_rows_.size() )
         {
-            func->num_locals = locals_.size() - row->first_local;
-        }
-        func->locals = &locals_[row->first_local];
-
-        // Now that we have locals info, fill in names in signatures
-        for( size_t arg = 0; arg < func->signature.nargs; arg++ )
-        {
-            SmxVariable* arg_local = func->FindLocalByStackOffset( (int)arg * 4 + 12 );
-            if( !arg_local )
-                continue;
-            assert( arg_local->vclass == SmxVariableClass::ARG );
-            func->signature.args[arg].name = arg_local->name;
+            assert( !"Invalid debug table" );
+            continue;
         }
+        dbg_method_rows_[row->method_index] = i;
     }
 }
 
@@ -659,9 +802,15 @@ void SmxFile::ReadDbgGlobals( const char* name, size_t offset, size_t size )
     for( size_t i = 0; i < rttihdr->row_count; i++ )
     {
         auto* row = reinterpret_cast<const smx_rtti_debug_var*>( image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size );
-        SmxVariable* var = FindGlobalAt( row->address );
-        if( !var )
+        SmxVariable* var;
+        auto it = global_index_.find( row->address );
+        if( it != global_index_.end() )
         {
+            var = &globals_[it->second];
+        }
+        else
+        {
+            global_index_.emplace( row->address, globals_.size() );
             globals_.emplace_back();
             var = &globals_.back();
         }
@@ -676,18 +825,94 @@ void SmxFile::ReadDbgGlobals( const char* name, size_t offset, size_t size )
 void SmxFile::ReadDbgLocals( const char* name, size_t offset, size_t size )
 {
     auto* rttihdr = reinterpret_cast<const smx_rtti_table_header*>( image_.get() + offset );
+    dbg_locals_ = image_.get() + offset;
 
-    locals_.reserve( rttihdr->row_count );
-    for( size_t i = 0; i < rttihdr->row_count; i++ )
+    // Rows are decoded per function in LoadFunctionDebugInfo, sized up front so that
+    // pointers into it stay valid
+    locals_.resize( rttihdr->row_count );
+}
+
+void SmxFile::LoadFunctionDebugInfo( SmxFunction& func )
+{
+    // Checked again under the lock, another thread may have loaded it in the meantime. Loading is
+    // marked separately from loaded since filling in the arg names below re-enters here
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    if( func.debug_info_loaded_.load( std::memory_order_relaxed ) || func.debug_info_loading_ )
+        return;
+    func.debug_info_loading_ = true;
+    ReadFunctionDebugInfo( func );
+    func.debug_info_loaded_.store( true, std::memory_order_release );
+}
+
+void SmxFile::ReadFunctionDebugInfo( SmxFunction& func )
+{
+    if( func.rtti_index_ == SmxFunction::NO_RTTI )
+        return;
+
+    auto* method = GetRttiRow<smx_rtti_method>( rtti_methods_, func.rtti_index_ );
+    func.signature_ = DecodeFunctionSignature( method->signature );
+
+    LoadSection( dbg_methods_section_ );
+    LoadSection( dbg_locals_section_ );
+    if( !dbg_methods_ || !dbg_locals_ || dbg_method_rows_[func.rtti_index_] == SmxFunction::NO_RTTI )
+        return;
+
+    size_t dbg_row = dbg_method_rows_[func.rtti_index_];
+    auto* row = GetRttiRow<smx_rtti_debug_method>( dbg_methods_, dbg_row );
+    if( dbg_row != GetRttiRowCount( dbg_methods_ ) - 1 )
     {
-        auto* row = reinterpret_cast<const smx_rtti_debug_var*>( image_.get() + offset + rttihdr->header_size + i * rttihdr->row_size );
-        SmxVariable var;
-        var.name = names_ + row->name;
-        var.address = row->address;
-        var.type = DecodeVariableType( row->type_id );
-        var.vclass = (SmxVariableClass)row->vclass;
-        locals_.push_back( var );
+        auto* next_row = GetRttiRow<smx_rtti_debug_method>( dbg_methods_, dbg_row + 1 );
+        func.num_locals_ = next_row->first_local - row->first_local;
+    }
+    else
+    {
+        func.num_locals_ = locals_.size() - row->first_local;
+    }
+    func.locals_ = locals_.data() + row->first_local;
+
+    for( size_t i = 0; i < func.num_locals_; i++ )
+    {
+        func.locals_[i] = DecodeDbgVariable( GetRttiRow<smx_rtti_debug_var>( dbg_locals_, row->first_local + i ) );
     }
+
+    // Now that we have locals info, fill in names in signatures
+    for( size_t arg = 0; arg < func.signature_.nargs; arg++ )
+    {
+        SmxVariable* arg_local = func.FindLocalByStackOffset( (int)arg * 4 + 12 );
+        if( !arg_local )
+            continue;
+        assert( arg_local->vclass == SmxVariableClass::ARG );
+        func.signature_.args[arg].name = arg_local->name;
+    }
+}
+
+void SmxFile::LoadNativeSignature( SmxNative& native )
+{
+    // Checked again under the lock, another thread may have loaded it in the meantime
+    std::lock_guard<std::recursive_mutex> lock( mutex_ );
+    if( native.signature_loaded_.load( std::memory_order_relaxed ) )
+        return;
+
+    LoadSection( rtti_natives_section_ );
+    if( rtti_natives_ && native.index_ < GetRttiRowCount( rtti_natives_ ) )
+    {
+        auto* row = GetRttiRow<smx_rtti_native>( rtti_natives_, native.index_ );
+        assert( strcmp( native.name, names_ + row->name ) == 0 );
+
+        native.name = names_ + row->name;
+        native.signature_ = DecodeFunctionSignature( row->signature );
+    }
+    native.signature_loaded_.store( true, std::memory_order_release );
+}
+
+SmxVariable SmxFile::DecodeDbgVariable( const smx_rtti_debug_var* row )
+{
+    SmxVariable var;
+    var.name = names_ + row->name;
+    var.address = row->address;
+    var.type = DecodeVariableType( row->type_id );
+    var.vclass = (SmxVariableClass)row->vclass;
+    return var;
 }
 
 // These are control bytes for type signatures.
@@ -843,6 +1068,7 @@ SmxVariableType SmxFile::DecodeVariableType( unsigned char** data )
         case cb::kEnum:
         {
             uint32_t index = DecodeUint32( &d );
+            LoadSection( enums_section_ );
             type.tag = SmxVariableType::ENUM;
             type.enumeration = &enums_[index];
             break;
@@ -850,6 +1076,7 @@ SmxVariableType SmxFile::DecodeVariableType( unsigned char** data )
         case cb::kTypedef:
         {
             uint32_t index = DecodeUint32( &d );
+            LoadSection( typedefs_section_ );
             type.tag = SmxVariableType::TYPEDEF;
             type.type_def = &typedefs_[index];
             break;
@@ -857,6 +1084,7 @@ SmxVariableType SmxFile::DecodeVariableType( unsigned char** data )
         case cb::kTypeset:
         {
             uint32_t index = DecodeUint32( &d );
+            LoadSection( typesets_section_ );
             type.tag = SmxVariableType::TYPESET;
             type.type_set = &typesets_[index];
             break;
@@ -864,6 +1092,7 @@ SmxVariableType SmxFile::DecodeVariableType( unsigned char** data )
         case cb::kClassdef:
         {
             uint32_t index = DecodeUint32( &d );
+            LoadSection( classdefs_section_ );
             type.tag = SmxVariableType::CLASSDEF;
             type.classdef = &classdefs_[index];
             break;
@@ -871,6 +1100,7 @@ SmxVariableType SmxFile::DecodeVariableType( unsigned char** data )
         case cb::kEnumStruct:
         {
             uint32_t index = DecodeUint32( &d );
+            LoadSection( enum_structs_section_ );
             type.tag = SmxVariableType::ENUM_STRUCT;
             type.enum_struct = &enum_structs_[index];
             break;
@@ -1,10 +1,17 @@
 #pragma once
 
 #include <vector>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <unordered_map>
 
 using cell_t = int32_t;
 
+class SmxFile;
+
 struct SmxSection
 {
 	const char* name;
@@ -91,25 +98,52 @@ struct SmxFunction
 	cell_t pcode_start = 0;
 	cell_t pcode_end = 0;
 	bool is_public = false;
-	SmxFunctionSignature signature;
-	size_t num_locals = 0;
-	SmxVariable* locals = nullptr;
+
+	// Signature and locals are only decoded from the rtti/debug tables once they are first requested
+	SmxFunctionSignature& signature() { LoadDebugInfo(); return signature_; }
+	size_t num_locals() { LoadDebugInfo(); return num_locals_; }
+	SmxVariable& local( size_t index ) { LoadDebugInfo(); return locals_[index]; }
 
 	SmxVariable* FindLocalByStackOffset( int stack_offset )
 	{
-		for( size_t i = 0; i < num_locals; i++ )
+		LoadDebugInfo();
+		for( size_t i = 0; i < num_locals_; i++ )
 		{
-			if( locals[i].address == stack_offset )
-				return &locals[i];
+			if( locals_[i].address == stack_offset )
+				return &locals_[i];
 		}
 		return nullptr;
 	}
+private:
+	friend class SmxFile;
+	static constexpr size_t NO_RTTI = (size_t)-1;
+
+	void LoadDebugInfo();
+
+	SmxFile* smx_ = nullptr;
+	size_t rtti_index_ = NO_RTTI; // Row in rtti.methods
+	std::atomic<bool> debug_info_loaded_{ false }; // Only set once everything below is filled in
+	bool debug_info_loading_ = false;
+	SmxFunctionSignature signature_;
+	size_t num_locals_ = 0;
+	SmxVariable* locals_ = nullptr;
 };
 
 struct SmxNative
 {
-	const char* name;
-	SmxFunctionSignature signature;
+	const char* name = nullptr;
+
+	// Signature is only decoded from rtti.natives once it is first requested
+	SmxFunctionSignature& signature() { LoadSignature(); return signature_; }
+private:
+	friend class SmxFile;
+
+	void LoadSignature();
+
+	SmxFile* smx_ = nullptr;
+	size_t index_ = 0;
+	std::atomic<bool> signature_loaded_{ false }; // Only set once signature_ is filled in
+	SmxFunctionSignature signature_;
 };
 
 struct SmxEnum
@@ -188,31 +222,55 @@ public:
 
 	void AddFunction( cell_t addr );
 
-	size_t num_functions() const { return functions_.size(); }
-	SmxFunction& function( size_t index ) { return functions_[index]; }
+	size_t num_functions() const { std::lock_guard<std::recursive_mutex> lock( mutex_ ); return functions_.size(); }
+	SmxFunction& function( size_t index ) { std::lock_guard<std::recursive_mutex> lock( mutex_ ); return functions_[index]; }
 	size_t num_natives() const { return natives_.size(); }
 	SmxNative& native( size_t index ) { return natives_[index]; }
-	size_t num_enumerations() const { return enums_.size(); }
-	SmxEnum& enumeration( size_t index ) { return enums_[index]; }
-	size_t num_type_defs() const { return typedefs_.size(); }
-	SmxTypeDef& type_def( size_t index ) { return typedefs_[index]; }
-	size_t num_type_sets() const { return typedefs_.size(); }
-	SmxTypeDef& type_set( size_t index ) { return typedefs_[index]; }
-	size_t num_enum_structs() const { return enum_structs_.size(); }
-	SmxEnumStruct& enum_struct( size_t index ) { return enum_structs_[index]; }
-	size_t num_globals() const { return globals_.size(); }
-	SmxVariable& global( size_t index ) { return globals_[index]; }
+	size_t num_enumerations() { LoadSection( enums_section_ ); return enums_.size(); }
+	SmxEnum& enumeration( size_t index ) { LoadSection( enums_section_ ); return enums_[index]; }
+	size_t num_type_defs() { LoadSection( typedefs_section_ ); return typedefs_.size(); }
+	SmxTypeDef& type_def( size_t index ) { LoadSection( typedefs_section_ ); return typedefs_[index]; }
+	size_t num_type_sets() { LoadSection( typedefs_section_ ); return typedefs_.size(); }
+	SmxTypeDef& type_set( size_t index ) { LoadSection( typedefs_section_ ); return typedefs_[index]; }
+	size_t num_enum_structs() { LoadSection( enum_structs_section_ ); return enum_structs_.size(); }
+	SmxEnumStruct& enum_struct( size_t index ) { LoadSection( enum_structs_section_ ); return enum_structs_[index]; }
+	size_t num_globals() { LoadSection( dbg_globals_section_ ); return globals_.size(); }
+	SmxVariable& global( size_t index ) { LoadSection( dbg_globals_section_ ); return globals_[index]; }
 
 	cell_t* code( size_t addr = 0 ) const { return (cell_t*)((uintptr_t)code_ + addr); }
 	size_t code_size() const { return code_size_; }
 	cell_t* data( size_t addr = 0 ) const { return (cell_t*)((uintptr_t)data_ + addr); }
 	size_t data_size() const { return data_size_; }
+
+	// String detection over .data, the bitmaps for it are built for the whole section on first use.
+	// A string start is a non-NUL byte preceded by a NUL
+	bool IsStringStart( cell_t addr ) { LoadSection( data_strings_section_ ); return (size_t)addr < data_size_ && TestBit( string_start_bits_, addr ); }
+	// Length of the string at addr, up to the next NUL or the end of .data
+	size_t StringLength( cell_t addr );
+	// Whether the string at addr has no control characters, so it can be written out without escapes other than quotes
+	bool IsPrintableString( cell_t addr );
 private:
+	friend struct SmxFunction;
+	friend struct SmxNative;
+
+	// A section that isn't read until something first needs its contents
+	struct LazySection
+	{
+		const char* name;
+		void (SmxFile::*reader)( const char* name, size_t offset, size_t size );
+		std::atomic<bool> loaded{ false }; // Only set once the reader is done
+		bool loading = false;
+	};
+
 	SmxSection* GetSectionByName( const char* name );
 	void ReadSections();
+	// Sections are shared between threads, the lock is only needed until the section is loaded
+	void LoadSection( LazySection& lazy ) { if( !lazy.loaded.load( std::memory_order_acquire ) ) ReadLazySection( lazy ); }
+	void ReadLazySection( LazySection& lazy );
 
 	void ReadCode( const char* name, size_t offset, size_t size );
 	void ReadData( const char* name, size_t offset, size_t size );
+	void ReadDataStrings( const char* name, size_t offset, size_t size );
 	void ReadNames( const char* name, size_t offset, size_t size );
 	void ReadPublics( const char* name, size_t offset, size_t size );
 	void ReadPubvars( const char* name, size_t offset, size_t size );
@@ -231,11 +289,20 @@ private:
 	void ReadDbgGlobals( const char* name, size_t offset, size_t size );
 	void ReadDbgLocals( const char* name, size_t offset, size_t size );
 
+	void LoadFunctionDebugInfo( SmxFunction& func );
+	void ReadFunctionDebugInfo( SmxFunction& func );
+	void LoadNativeSignature( SmxNative& native );
+	SmxVariable DecodeDbgVariable( const struct smx_rtti_debug_var* row );
+
 	SmxVariableType DecodeVariableType( uint32_t type_id );
 	SmxVariableType DecodeVariableType( unsigned char** data );
 	SmxFunctionSignature DecodeFunctionSignature( uint32_t signature );
 	SmxFunctionSignature DecodeFunctionSignature( unsigned char** data );
 	uint32_t DecodeUint32( unsigned char** data );
+
+	static bool TestBit( const std::vector<uint64_t>& bits, size_t index ) { return (bits[index / 64] >> (index % 64)) & 1; }
+	// Index of the first set bit at or after index, or end if there is none before it
+	static size_t FindNextBit( const std::vector<uint64_t>& bits, size_t index, size_t end );
 private:
 	std::unique_ptr<char[]> image_;
 	char* stringtab_ = nullptr;
@@ -246,9 +313,15 @@ private:
 	size_t data_size_ = 0;
 	char* names_ = nullptr;
 	unsigned char* rtti_data_ = nullptr;
-	std::vector<SmxFunction> functions_;
-	std::vector<SmxFunction*> rtti_methods_;
-	std::vector<SmxNative> natives_;
+	const char* rtti_methods_ = nullptr;
+	const char* rtti_natives_ = nullptr;
+	const char* dbg_methods_ = nullptr;
+	const char* dbg_locals_ = nullptr;
+	// Deque so that references stay valid when functions are added during decompilation
+	std::deque<SmxFunction> functions_;
+	std::map<cell_t, SmxFunction*> function_index_; // Start address -> function, kept sorted for FindFunctionAt
+	std::vector<size_t> dbg_method_rows_; // .dbg.methods row for each rtti.methods row
+	std::deque<SmxNative> natives_;
 	std::vector<SmxEnum> enums_;
 	std::vector<SmxTypeDef> typedefs_;
 	std::vector<SmxTypeSet> typesets_;
@@ -257,5 +330,41 @@ private:
 	std::vector<SmxClassDef> classdefs_;
 	std::vector<SmxField> fields_;
 	std::vector<SmxVariable> globals_;
+	std::unordered_map<cell_t, size_t> global_index_; // Address -> index into globals_
 	std::vector<SmxVariable> locals_;
-};
\ No newline at end of file
+	// One bit per byte of .data
+	std::vector<uint64_t> nul_bits_;
+	std::vector<uint64_t> control_bits_; // Bytes below 0x20, including NUL
+	std::vector<uint64_t> string_start_bits_;
+
+	// Guards everything that is filled in after construction (added functions, lazily read tables) so
+	// that functions from the same file can be decompiled on multiple threads
+	mutable std::recursive_mutex mutex_;
+
+	LazySection rtti_natives_section_     { "rtti.natives",           &SmxFile::ReadRttiNatives };
+	LazySection enums_section_            { "rtti.enums",             &SmxFile::ReadRttiEnums };
+	LazySection typedefs_section_         { "rtti.typedefs",          &SmxFile::ReadRttiTypeDefs };
+	LazySection typesets_section_         { "rtti.typesets",          &SmxFile::ReadRttiTypeSets };
+	LazySection fields_section_           { "rtti.fields",            &SmxFile::ReadRttiFields };
+	LazySection classdefs_section_        { "rtti.classdefs",         &SmxFile::ReadRttiClassdefs };
+	LazySection es_fields_section_        { "rtti.enumstruct_fields", &SmxFile::ReadRttiEnumStructFields };
+	LazySection enum_structs_section_     { "rtti.enumstructs",       &SmxFile::ReadRttiEnumStructs };
+	LazySection dbg_globals_section_      { ".dbg.globals",           &SmxFile::ReadDbgGlobals };
+	LazySection dbg_locals_section_       { ".dbg.locals",            &SmxFile::ReadDbgLocals };
+	LazySection dbg_methods_section_      { ".dbg.methods",           &SmxFile::ReadDbgMethods };
+	LazySection data_strings_section_     { ".data",                  &SmxFile::ReadDataStrings };
+};
+
+inline void SmxFunction::LoadDebugInfo()
+{
+	// Functions are shared between threads, the lock is only needed until the info is loaded
+	if( smx_ && !debug_info_loaded_.load( std::memory_order_acquire ) )
+		smx_->LoadFunctionDebugInfo( *this );
+}
+
+inline void SmxNative::LoadSignature()
+{
+	// Same as for functions, natives are shared between threads
+	if( smx_ && !signature_loaded_.load( std::memory_order_acquire ) )
+		smx_->LoadNativeSignature( *this );
+}
@@ -213,4 +213,23 @@ const SmxInstrInfo& SmxInstrInfo::Get( uint32_t op )
 		return instrs[op];
 	}
 	return err_instr;
-}
\ No newline at end of file
+}
+
+const int32_t* SmxInstrInfo::Next( const int32_t* instr, const int32_t* end )
+{
+	int num_params = Get( (uint32_t)instr[0] ).num_params;
+	if( num_params < 0 )
+		return instr + 1;
+	if( end - instr <= num_params )
+		return nullptr;
+
+	if( instr[0] == SMX_OP_CASETBL )
+	{
+		// The case table follows, two cells per case
+		int32_t ncases = instr[1];
+		if( ncases < 0 || ( end - instr - 1 - num_params ) / 2 < ncases )
+			return nullptr;
+		num_params += 2 * ncases;
+	}
+	return instr + num_params + 1;
+}
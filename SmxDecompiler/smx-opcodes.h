@@ -259,4 +259,8 @@ struct SmxInstrInfo
 
     static const SmxInstrInfo& Get( SmxOpcode op );
     static const SmxInstrInfo& Get( uint32_t op );
+
+    // Instruction following instr, or nullptr if instr doesn't fit before end (cut off, or a case
+    // table with a bad count). Ungen opcodes are stepped over a cell at a time, as CfgBuilder does
+    static const int32_t* Next( const int32_t* instr, const int32_t* end );
 };
\ No newline at end of file
@@ -72,18 +72,19 @@ public:
 	BasicStatement( ILBlock* block, Statement* next ) :
 		Statement( StatementType::BASIC, next )
 	{
-		size_t end = block->num_nodes();
+		ILNode* end = nullptr;
 
 		// If this is a jump then we don't want to include it, but if it is a fallthrough then keep it
 		if( block->num_out_edges() > 1 ||
 			dynamic_cast<ILJump*>(block->Last()) ||
 			dynamic_cast<ILSwitch*>(block->Last()))
 		{
-			end -= 1;
+			end = block->Last();
 		}
 
-		for( size_t i = 0; i < end; i++ )
-			nodes_.push_back( block->node( i ) );
+		nodes_.reserve( block->num_nodes() );
+		for( ILNode* node = block->First(); node != end; node = node->next() )
+			nodes_.push_back( node );
 	}
 
 	size_t num_nodes() const { return nodes_.size(); }
@@ -33,9 +33,9 @@ void Structurizer::FindBlocksInInterval( ILBlock* interval, size_t level, std::v
 {
 	if( level > 0 )
 	{
-		for( size_t i = 0; i < interval->num_nodes(); i++ )
+		for( ILNode* node = interval->First(); node; node = node->next() )
 		{
-			ILInterval* I = static_cast<ILInterval*>( interval->node( i ) );
+			ILInterval* I = static_cast<ILInterval*>( node );
 			FindBlocksInInterval( I->block(), level - 1, blocks );
 		}
 	}
@@ -45,7 +45,7 @@ void Structurizer::FindBlocksInInterval( ILBlock* interval, size_t level, std::v
 	}
 }
 
-void Structurizer::FindBlocksInLoop( ILBlock* head, ILBlock* latch, const std::vector<ILBlock*>& interval )
+void Structurizer::FindBlocksInLoop( ILBlock* head, ILBlock* latch, const std::vector<bool>& in_interval )
 {
 	LoopHead( head ) = head;
 	for( size_t i = head->id() + 1; i < latch->id(); i++ )
@@ -54,7 +54,7 @@ void Structurizer::FindBlocksInLoop( ILBlock* head, ILBlock* latch, const std::v
 		ILBlock* immed_dominator = bb->immed_dominator();
 		if( LoopHead( immed_dominator ) == head &&
 			LoopHead( bb ) == nullptr &&
-			std::find( interval.begin(), interval.end(), bb ) != interval.end() )
+			in_interval[i] )
 		{
 			LoopHead( bb ) = head;
 		}
@@ -90,6 +90,8 @@ void Structurizer::FindBlocksInLoop( ILBlock* head, ILBlock* latch, const std::v
 void Structurizer::MarkLoops()
 {
 	std::vector<ILBlock*> blocks;
+	// Membership of the blocks of the current interval, set and cleared again per interval
+	std::vector<bool> in_interval( cfg()->num_blocks(), false );
 
 	for( size_t level = 1; level < derived_.size(); level++ )
 	{
@@ -102,20 +104,23 @@ void Structurizer::MarkLoops()
 
 			// Get interval basic blocks
 			FindBlocksInInterval( &G->block( Ii ), level, blocks );
+			for( ILBlock* bb : blocks )
+				in_interval[bb->id()] = true;
 
 			ILBlock* head = blocks[0];
 
 			// Find greatest back edge in current interval
-			for( size_t i = 0; i < head->num_in_edges(); i++ )
+			const BlockEdges& edges = cfg()->edges();
+			for( size_t i = 0; i < edges.num_in_edges( head->id() ); i++ )
 			{
-				ILBlock* pred = &head->in_edge( i );
+				ILBlock* pred = &cfg()->block( edges.in_edge( head->id(), i ) );
 
 				// Must be a back edge
 				if( pred->id() <= head->id() )
 					continue;
 				
 				// Must be in current interval
-				if( std::find( blocks.begin(), blocks.end(), pred ) == blocks.end() )
+				if( !in_interval[pred->id()] )
 					continue;
 
 				if( !latch || ( pred->id() > latch->id() ) )
@@ -126,14 +131,36 @@ void Structurizer::MarkLoops()
 
 			if( latch && LoopHead( latch ) == nullptr )
 			{
-				FindBlocksInLoop( head, latch, blocks );
+				FindBlocksInLoop( head, latch, in_interval );
 			}
+
+			for( ILBlock* bb : blocks )
+				in_interval[bb->id()] = false;
 		}
 	}
 }
 
 void Structurizer::MarkIfs()
 {
+	// Children of each block in the dominator tree, in order of id
+	std::vector<uint32_t> child_start( cfg()->num_blocks() + 1, 0 );
+	std::vector<ILBlock*> children( cfg()->num_blocks() );
+	for( size_t i = 0; i < cfg()->num_blocks(); i++ )
+	{
+		ILBlock* immed_dominator = cfg()->block( i ).immed_dominator();
+		if( immed_dominator && immed_dominator->id() != i )
+			child_start[immed_dominator->id() + 1]++;
+	}
+	for( size_t i = 0; i < cfg()->num_blocks(); i++ )
+		child_start[i + 1] += child_start[i];
+	std::vector<uint32_t> next_child( child_start.begin(), child_start.end() - 1 );
+	for( size_t i = 0; i < cfg()->num_blocks(); i++ )
+	{
+		ILBlock* immed_dominator = cfg()->block( i ).immed_dominator();
+		if( immed_dominator && immed_dominator->id() != i )
+			children[next_child[immed_dominator->id()]++] = &cfg()->block( i );
+	}
+
 	for( int i = (int)cfg()->num_blocks() - 1; i >= 0; i-- )
 	{
 		ILBlock* bb = &cfg()->block( i );
@@ -149,10 +176,11 @@ void Structurizer::MarkIfs()
 		}
 		else
 		{
-			for( int j = i + 1; j < cfg()->num_blocks(); j++ )
+			// First block after this one that it immediately dominates, other than its successors
+			for( uint32_t j = child_start[i]; j < child_start[i + 1]; j++ )
 			{
-				ILBlock* potential_follow = &cfg()->block( j );
-				if( potential_follow->immed_dominator() == bb &&
+				ILBlock* potential_follow = children[j];
+				if( potential_follow->id() > (size_t)i &&
 					potential_follow != &bb->out_edge( 0 ) &&
 					potential_follow != &bb->out_edge( 1 ) )
 				{
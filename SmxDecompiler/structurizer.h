@@ -29,7 +29,7 @@ private:
 	};
 
 	void FindBlocksInInterval( ILBlock* interval, size_t level, std::vector<ILBlock*>& blocks );
-	void FindBlocksInLoop( ILBlock* head, ILBlock* latch, const std::vector<ILBlock*>& blocks );
+	void FindBlocksInLoop( ILBlock* head, ILBlock* latch, const std::vector<bool>& in_interval );
 	void MarkLoops();
 	void MarkIfs();
 	ILBlock*& LoopHead( ILBlock* bb ) { return loop_heads_[bb->id()]; }
@@ -0,0 +1,122 @@
+#include "trace.h"
+
+#include <fstream>
+#include "json.h"
+
+std::atomic<bool> Trace::enabled_( false );
+std::chrono::steady_clock::time_point Trace::start_;
+
+std::mutex Trace::buffers_mutex_;
+std::vector<std::unique_ptr<Trace::Buffer>> Trace::buffers_;
+
+void Trace::Start()
+{
+	start_ = std::chrono::steady_clock::now();
+	enabled_ = true;
+}
+
+uint64_t Trace::Now()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start_ ).count();
+}
+
+Trace::Buffer& Trace::ThreadBuffer()
+{
+	thread_local Buffer* buffer = nullptr;
+	if( !buffer )
+	{
+		std::lock_guard<std::mutex> lock( buffers_mutex_ );
+		buffers_.push_back( std::make_unique<Buffer>() );
+		buffer = buffers_.back().get();
+		buffer->tid = (uint32_t)buffers_.size();
+	}
+	return *buffer;
+}
+
+bool Trace::Write( const char* path )
+{
+	std::lock_guard<std::mutex> lock( buffers_mutex_ );
+
+	JsonWriter json;
+	json.BeginObject()
+		.Key( "displayTimeUnit" ).String( "ms" )
+		.Key( "traceEvents" ).BeginArray();
+	for( const auto& buffer : buffers_ )
+	{
+		std::string thread_name = "thread " + std::to_string( buffer->tid );
+		json.BeginObject()
+			.Key( "name" ).String( "thread_name" )
+			.Key( "ph" ).String( "M" )
+			.Key( "pid" ).Number( (int64_t)1 )
+			.Key( "tid" ).Number( (int64_t)buffer->tid )
+			.Key( "args" ).BeginObject().Key( "name" ).String( thread_name ).EndObject()
+			.EndObject();
+
+		for( const Event& event : buffer->events )
+		{
+			// Spans still open weren't finished when the trace was written
+			if( event.end < event.start )
+				continue;
+
+			json.BeginObject()
+				.Key( "name" ).String( event.name )
+				.Key( "cat" ).String( "decompiler" )
+				.Key( "ph" ).String( "X" )
+				.Key( "ts" ).Number( event.start / 1000.0 )
+				.Key( "dur" ).Number( ( event.end - event.start ) / 1000.0 )
+				.Key( "pid" ).Number( (int64_t)1 )
+				.Key( "tid" ).Number( (int64_t)buffer->tid );
+			if( event.detail || event.function )
+			{
+				json.Key( "args" ).BeginObject();
+				if( event.function )
+					json.Key( "function" ).String( buffer->strings[event.function] );
+				if( event.detail )
+					json.Key( "detail" ).String( buffer->strings[event.detail] );
+				json.EndObject();
+			}
+			json.EndObject();
+		}
+	}
+	json.EndArray().EndObject();
+
+	std::ofstream out( path, std::ios::binary );
+	out << json.str() << '\n';
+	return out.good();
+}
+
+void TraceSpan::Begin( const char* name, const char* detail )
+{
+	buffer_ = &Trace::ThreadBuffer();
+	event_ = buffer_->events.size();
+
+	uint32_t detail_index = 0;
+	if( detail )
+	{
+		detail_index = (uint32_t)buffer_->strings.size();
+		buffer_->strings.emplace_back( detail );
+	}
+
+	// end stays before start until the span is finished
+	buffer_->events.push_back( { name, detail_index, buffer_->function, Trace::Now(), 0 } );
+}
+
+TraceFunction::TraceFunction( const std::string& name ) :
+	TraceSpan( "Decompile", name.c_str() )
+{
+	if( !buffer_ )
+		return;
+
+	// The name goes in as the function of this span too, rather than as its detail
+	Trace::Event& event = buffer_->events[event_];
+	previous_function_ = buffer_->function;
+	buffer_->function = event.detail;
+	event.function = event.detail;
+	event.detail = 0;
+}
+
+TraceFunction::~TraceFunction()
+{
+	if( buffer_ )
+		buffer_->function = previous_function_;
+}
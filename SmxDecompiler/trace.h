@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline of the decompiler's work in the Chrome trace event format, for chrome://tracing or
+// ui.perfetto.dev. Every thread records its spans into a buffer of its own without any locking,
+// the buffers are only gathered when the trace is written. While tracing is off a span costs a
+// single check of a flag
+class Trace
+{
+public:
+	static void Start();
+	static bool enabled() { return enabled_.load( std::memory_order_relaxed ); }
+	// Writes everything recorded so far, no thread may still be recording
+	static bool Write( const char* path );
+private:
+	friend class TraceSpan;
+	friend class TraceFunction;
+
+	struct Event
+	{
+		const char* name;
+		uint32_t detail;   // Index into the buffer's strings, 0 for none
+		uint32_t function; // Same, for the function being worked on
+		uint64_t start;    // Nanoseconds since Start
+		uint64_t end;
+	};
+	struct Buffer
+	{
+		uint32_t tid;
+		uint32_t function = 0;
+		std::vector<Event> events;
+		std::vector<std::string> strings{ "" };
+	};
+
+	static Buffer& ThreadBuffer();
+	static uint64_t Now();
+private:
+	static std::atomic<bool> enabled_;
+	static std::chrono::steady_clock::time_point start_;
+
+	// Buffers stay around after their threads exit so they can still be written
+	static std::mutex buffers_mutex_;
+	static std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+// Records the time from construction to destruction as a span on the calling thread. name has to
+// outlive the trace (use literals), detail is copied
+class TraceSpan
+{
+public:
+	explicit TraceSpan( const char* name, const char* detail = nullptr )
+	{
+		if( Trace::enabled() )
+			Begin( name, detail );
+	}
+	~TraceSpan()
+	{
+		if( buffer_ )
+			buffer_->events[event_].end = Trace::Now();
+	}
+	TraceSpan( const TraceSpan& ) = delete;
+	TraceSpan& operator=( const TraceSpan& ) = delete;
+protected:
+	void Begin( const char* name, const char* detail );
+protected:
+	Trace::Buffer* buffer_ = nullptr;
+	size_t event_ = 0;
+};
+
+// Span covering all work on a function, the spans recorded inside it are tagged with its name
+class TraceFunction : public TraceSpan
+{
+public:
+	explicit TraceFunction( const std::string& name );
+	~TraceFunction();
+private:
+	uint32_t previous_function_ = 0;
+};
@@ -1,26 +1,26 @@
 #include "typer.h"
 
-class SmxVariableVisitor : public RecursiveILVisitor
+class SmxVariableVisitor : public StaticRecursiveILVisitor<SmxVariableVisitor>
 {
 public:
-	SmxVariableVisitor( SmxFile& smx, const SmxFunction* func ) :
+	SmxVariableVisitor( SmxFile& smx, SmxFunction* func ) :
 		smx_( &smx ),
 		func_( func )
 	{}
 
-	virtual void VisitLocalVar( ILLocalVar* node ) override
+	void VisitLocalVar( ILLocalVar* node )
 	{
-		RecursiveILVisitor::VisitLocalVar( node );
+		StaticRecursiveILVisitor::VisitLocalVar( node );
 
 		// This has already been filled, can skip
 		if( node->smx_var() )
 			return;
 
-		for( size_t i = 0; i < func_->num_locals; i++ )
+		for( size_t i = 0; i < func_->num_locals(); i++ )
 		{
-			if( func_->locals[i].address == node->stack_offset() )
+			if( func_->local( i ).address == node->stack_offset() )
 			{
-				node->SetSmxVar( &func_->locals[i] );
+				node->SetSmxVar( &func_->local( i ) );
 				break;
 			}
 		}
@@ -28,7 +28,7 @@ public:
 		if( node->smx_var() )
 			node->SetType( &node->smx_var()->type );
 	}
-	virtual void VisitGlobalVar( ILGlobalVar* node ) override
+	void VisitGlobalVar( ILGlobalVar* node )
 	{
 		// This has already been filled, can skip
 		if( node->smx_var() )
@@ -41,51 +41,51 @@ public:
 		node->SetSmxVar( var );
 		node->SetType( &var->type );
 	}
-	virtual void VisitCall( ILCall* node ) override
+	void VisitCall( ILCall* node )
 	{
-		RecursiveILVisitor::VisitCall( node );
+		StaticRecursiveILVisitor::VisitCall( node );
 
 		SmxFunction* func = smx_->FindFunctionAt( node->addr() );
 		if( !func )
 			return;
 
-		node->SetType( func->signature.ret );
+		node->SetType( func->signature().ret );
 
-		for( size_t i = 0; i < std::min( func->signature.nargs, node->num_args() ); i++ )
+		for( size_t i = 0; i < std::min( func->signature().nargs, node->num_args() ); i++ )
 		{
 			ILNode* arg = node->arg( i );
 			if( arg->type() )
 				continue;
-			arg->SetType( &func->signature.args[i].type );
+			arg->SetType( &func->signature().args[i].type );
 		}
 	}
-	virtual void VisitNative( ILNative* node ) override
+	void VisitNative( ILNative* node )
 	{
-		RecursiveILVisitor::VisitNative( node );
+		StaticRecursiveILVisitor::VisitNative( node );
 
 		SmxNative* func = smx_->FindNativeByIndex( node->native_index() );
 		if( !func )
 			return;
 
-		node->SetType( func->signature.ret );
+		node->SetType( func->signature().ret );
 
-		for( size_t i = 0; i < std::min(func->signature.nargs, node->num_args()); i++ )
+		for( size_t i = 0; i < std::min(func->signature().nargs, node->num_args()); i++ )
 		{
 			ILNode* arg = node->arg( i );
 			if( arg->type() )
 				continue;
-			arg->SetType( &func->signature.args[i].type );
+			arg->SetType( &func->signature().args[i].type );
 		}
 	}
 private:
 	SmxFile* smx_;
-	const SmxFunction* func_;
+	SmxFunction* func_;
 };
 
-class TypePropagator : public ILVisitor
+class TypePropagator : public StaticILVisitor<TypePropagator>
 {
 public:
-	TypePropagator( const SmxFunction* func ) :
+	TypePropagator( SmxFunction* func ) :
 		func_( func )
 	{
 		int_type_ = new SmxVariableType;
@@ -98,17 +98,12 @@ public:
 		float_type_->tag = SmxVariableType::FLOAT;
 	}
 
-	void Visit( ILNode* node )
-	{
-		node->Accept( this );
-	}
-
-	virtual void VisitConst( ILConst* node ) override
+	void VisitConst( ILConst* node )
 	{
 		if( !node->type() )
 			node->SetType( type() );
 	}
-	virtual void VisitUnary( ILUnary* node ) override
+	void VisitUnary( ILUnary* node )
 	{
 		switch( node->op() )
 		{	
@@ -146,7 +141,7 @@ public:
 
 		PopType();
 	}
-	virtual void VisitBinary( ILBinary* node ) override
+	void VisitBinary( ILBinary* node )
 	{
 		switch( node->op() )
 		{
@@ -208,7 +203,7 @@ public:
 		Visit( node->right() );
 		PopType();
 	}
-	virtual void VisitLocalVar( ILLocalVar* node ) override
+	void VisitLocalVar( ILLocalVar* node )
 	{
 		if( !node->type() )
 			node->SetType( type() );
@@ -220,17 +215,17 @@ public:
 			PopType();
 		}
 	}
-	virtual void VisitGlobalVar( ILGlobalVar* node ) override
+	void VisitGlobalVar( ILGlobalVar* node )
 	{
 		if( !node->type() )
 			node->SetType( type() );
 	}
-	virtual void VisitHeapVar( ILHeapVar* node ) override
+	void VisitHeapVar( ILHeapVar* node )
 	{
 		if( !node->type() )
 			node->SetType( type() );
 	}
-	virtual void VisitArrayElementVar( ILArrayElementVar* node ) override
+	void VisitArrayElementVar( ILArrayElementVar* node )
 	{
 		node->SetType( type() );
 
@@ -256,24 +251,24 @@ public:
 		Visit( node->index() );
 		PopType();
 	}
-	virtual void VisitFieldVar( ILFieldVar* node ) override
+	void VisitFieldVar( ILFieldVar* node )
 	{
 		if( !node->type() )
 			node->SetType( type() );
 
 		Visit( node->base() );
 	}
-	virtual void VisitTempVar( ILTempVar* node ) override
+	void VisitTempVar( ILTempVar* node )
 	{
 		if( !node->type() )
 			node->SetType( type() );
 	}
-	virtual void VisitLoad( ILLoad* node ) override
+	void VisitLoad( ILLoad* node )
 	{
 		Visit( node->var() );
 		node->SetType( node->var()->type() );
 	}
-	virtual void VisitStore( ILStore* node ) override
+	void VisitStore( ILStore* node )
 	{
 		Visit( node->var() );
 
@@ -291,26 +286,26 @@ public:
 		Visit( node->val() );
 		PopType();
 	}
-	virtual void VisitJumpCond( ILJumpCond* node ) override
+	void VisitJumpCond( ILJumpCond* node )
 	{
 		Visit( node->condition() );
 	}
-	virtual void VisitSwitch( ILSwitch* node ) override {}
-	virtual void VisitCall( ILCall* node ) override
+	void VisitSwitch( ILSwitch* node ) {}
+	void VisitCall( ILCall* node )
 	{
 		if( !node->type() )
 			node->SetType( type() );
 	}
-	virtual void VisitNative( ILNative* node ) override
+	void VisitNative( ILNative* node )
 	{
 		if( !node->type() )
 			node->SetType( type() );
 	}
-	virtual void VisitReturn( ILReturn* node ) override
+	void VisitReturn( ILReturn* node )
 	{
 		if( node->value() )
 		{
-			PushType( func_->signature.ret );
+			PushType( func_->signature().ret );
 			Visit( node->value() );
 			PopType();
 		}
@@ -320,17 +315,17 @@ private:
 	void PushType( const SmxVariableType* type ) { type_stack_.push_back( type ); }
 	void PopType() { type_stack_.pop_back(); }
 private:
-	const SmxFunction* func_;
+	SmxFunction* func_;
 	SmxVariableType* int_type_;
 	SmxVariableType* bool_type_;
 	SmxVariableType* float_type_;
 	std::vector<const SmxVariableType*> type_stack_;
 };
 
-class StructFinder : public RecursiveILVisitor
+class StructFinder : public StaticRecursiveILVisitor<StructFinder>
 {
 public:
-	virtual void VisitArrayElementVar( ILArrayElementVar* node ) override
+	void VisitArrayElementVar( ILArrayElementVar* node )
 	{
 		auto* var = dynamic_cast<ILVar*>( node->base() );
 		if( !var )
@@ -364,7 +359,7 @@ public:
 void Typer::PopulateTypes( ILControlFlowGraph& cfg )
 {
 	cell_t pc = cfg.Entry().pc();
-	const SmxFunction* func = smx_->FindFunctionAt( pc );
+	SmxFunction* func = smx_->FindFunctionAt( pc );
 
 	FillSmxVars( cfg, func );
 
@@ -372,7 +367,7 @@ void Typer::PopulateTypes( ILControlFlowGraph& cfg )
 	VisitAllNodes( cfg, struct_finder );
 }
 
-void Typer::FillSmxVars( ILControlFlowGraph& cfg, const SmxFunction* func )
+void Typer::FillSmxVars( ILControlFlowGraph& cfg, SmxFunction* func )
 {
 	SmxVariableVisitor fill_smx_vars( *smx_, func );
 	VisitAllNodes( cfg, fill_smx_vars );
@@ -381,7 +376,7 @@ void Typer::FillSmxVars( ILControlFlowGraph& cfg, const SmxFunction* func )
 void Typer::PropagateTypes( ILControlFlowGraph& cfg )
 {
 	cell_t pc = cfg.Entry().pc();
-	const SmxFunction* func = smx_->FindFunctionAt( pc );
+	SmxFunction* func = smx_->FindFunctionAt( pc );
 
 	TypePropagator propagator( func );
 	VisitAllNodes( cfg, propagator );
@@ -390,14 +385,15 @@ void Typer::PropagateTypes( ILControlFlowGraph& cfg )
 	VisitAllNodes( cfg, struct_finder );
 }
 
-void Typer::VisitAllNodes( ILControlFlowGraph& cfg, ILVisitor& visitor )
+template <typename Visitor>
+void Typer::VisitAllNodes( ILControlFlowGraph& cfg, Visitor& visitor )
 {
 	for( size_t i = 0; i < cfg.num_blocks(); i++ )
 	{
 		ILBlock& bb = cfg.block( i );
-		for( size_t node = 0; node < bb.num_nodes(); node++ )
+		for( ILNode* node = bb.First(); node; node = node->next() )
 		{
-			bb.node( node )->Accept( &visitor );
+			visitor.Visit( node );
 		}
 	}
 }
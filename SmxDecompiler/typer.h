@@ -11,8 +11,9 @@ public:
 	void PopulateTypes( ILControlFlowGraph& cfg );
 	void PropagateTypes( ILControlFlowGraph& cfg );
 private:
-	void FillSmxVars( ILControlFlowGraph& cfg, const SmxFunction* func );
-	void VisitAllNodes( ILControlFlowGraph& cfg, ILVisitor& visitor );
+	void FillSmxVars( ILControlFlowGraph& cfg, SmxFunction* func );
+	template <typename Visitor>
+	void VisitAllNodes( ILControlFlowGraph& cfg, Visitor& visitor );
 private:
 	SmxFile* smx_;
 };
\ No newline at end of file
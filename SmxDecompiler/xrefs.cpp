@@ -0,0 +1,491 @@
+#include "xrefs.h"
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+#include "smx-opcodes.h"
+#include "json.h"
+
+XrefIndex::XrefIndex( SmxFile& smx ) :
+	smx_( &smx )
+{
+	Scan();
+
+	by_target_ = by_addr_;
+	std::stable_sort( by_target_.begin(), by_target_.end(), []( const Xref& a, const Xref& b ) {
+		if( a.kind != b.kind )
+			return a.kind < b.kind;
+		return a.target < b.target;
+	} );
+}
+
+XrefIndex::Range XrefIndex::To( Kind kind, cell_t target ) const
+{
+	auto range = std::equal_range( by_target_.begin(), by_target_.end(), Xref{ kind, 0, 0, target },
+		[]( const Xref& a, const Xref& b ) {
+			if( a.kind != b.kind )
+				return a.kind < b.kind;
+			return a.target < b.target;
+		} );
+	return { by_target_.data() + (range.first - by_target_.begin()), by_target_.data() + (range.second - by_target_.begin()) };
+}
+
+XrefIndex::Range XrefIndex::From( cell_t func ) const
+{
+	auto range = std::equal_range( by_addr_.begin(), by_addr_.end(), Xref{ Kind::CALL, 0, func, 0 },
+		[]( const Xref& a, const Xref& b ) { return a.func < b.func; } );
+	return { by_addr_.data() + (range.first - by_addr_.begin()), by_addr_.data() + (range.second - by_addr_.begin()) };
+}
+
+void XrefIndex::Scan()
+{
+	const cell_t* code = smx_->code();
+	const cell_t* instr = code;
+	const cell_t* code_end = smx_->code( smx_->code_size() );
+	std::vector<const cell_t*> address_operands = FindAddressOperands( *smx_, code, code_end );
+	auto next_address = address_operands.begin();
+	cell_t func = 0;
+	while( instr < code_end )
+	{
+		// Code cut off in the middle of an instruction ends the scan
+		const cell_t* next = SmxInstrInfo::Next( instr, code_end );
+		if( !next )
+			break;
+
+		const auto& info = SmxInstrInfo::Get( instr[0] );
+		cell_t addr = (cell_t)((uintptr_t)instr - (uintptr_t)code);
+
+		// Only constants used as an address can take a global's, anything may point at a string
+		auto AddConstant = [&]( const cell_t* operand ) {
+			while( next_address != address_operands.end() && *next_address < operand )
+				++next_address;
+			bool is_address = next_address != address_operands.end() && *next_address == operand;
+			if( is_address && smx_->FindGlobalAt( *operand ) )
+				Add( Kind::GLOBAL_ADDR, addr, func, *operand );
+			else if( smx_->IsStringStart( *operand ) )
+				Add( Kind::DATA_REF, addr, func, *operand );
+		};
+
+		switch( instr[0] )
+		{
+		case SMX_OP_PROC:
+			func = addr;
+			functions_.push_back( addr );
+			break;
+		case SMX_OP_CALL:
+			Add( Kind::CALL, addr, func, instr[1] );
+			break;
+		case SMX_OP_SYSREQ_C:
+		case SMX_OP_SYSREQ_N:
+			Add( Kind::NATIVE, addr, func, instr[1] );
+			break;
+
+		case SMX_OP_LOAD_PRI:
+		case SMX_OP_LOAD_ALT:
+		case SMX_OP_LOAD_BOTH:
+		case SMX_OP_PUSH:
+		case SMX_OP_PUSH2:
+		case SMX_OP_PUSH3:
+		case SMX_OP_PUSH4:
+		case SMX_OP_PUSH5:
+			for( int param = 1; param <= info.num_params; param++ )
+				Add( Kind::GLOBAL_READ, addr, func, instr[param] );
+			break;
+		case SMX_OP_STOR_PRI:
+		case SMX_OP_STOR_ALT:
+		case SMX_OP_ZERO:
+		case SMX_OP_INC:
+		case SMX_OP_DEC:
+			Add( Kind::GLOBAL_WRITE, addr, func, instr[1] );
+			break;
+		case SMX_OP_CONST:
+			Add( Kind::GLOBAL_WRITE, addr, func, instr[1] );
+			AddConstant( instr + 2 );
+			break;
+
+		case SMX_OP_CONST_PRI:
+		case SMX_OP_CONST_ALT:
+		case SMX_OP_PUSH_C:
+		case SMX_OP_PUSH2_C:
+		case SMX_OP_PUSH3_C:
+		case SMX_OP_PUSH4_C:
+		case SMX_OP_PUSH5_C:
+			for( int param = 1; param <= info.num_params; param++ )
+				AddConstant( instr + param );
+			break;
+		}
+
+		instr = next;
+	}
+}
+
+void XrefIndex::Add( Kind kind, cell_t addr, cell_t func, cell_t target )
+{
+	by_addr_.push_back( { kind, addr, func, target } );
+}
+
+// Whether arguments for the parameter are passed by their address
+static bool IsAddressParam( const SmxFunctionSignature& sig, cell_t index )
+{
+	// The variadic parameter is the last one, everything passed to it goes by reference
+	if( sig.varargs && sig.nargs > 0 && (size_t)index >= sig.nargs - 1 )
+		return true;
+	if( (size_t)index >= sig.nargs )
+		return false;
+
+	const SmxVariableType& type = sig.args[index].type;
+	return ( type.flags & SmxVariableType::BY_REF ) || type.dimcount > 0 || type.tag == SmxVariableType::ENUM_STRUCT;
+}
+
+// Instructions that leave pri as it was, everything else not handled by FindAddressOperands is
+// taken to overwrite it
+static bool KeepsPri( cell_t op )
+{
+	switch( op )
+	{
+	case SMX_OP_LOAD_ALT:
+	case SMX_OP_LOAD_S_ALT:
+	case SMX_OP_LREF_S_ALT:
+	case SMX_OP_ADDR_ALT:
+	case SMX_OP_STOR_PRI:
+	case SMX_OP_STOR_ALT:
+	case SMX_OP_STOR_S_PRI:
+	case SMX_OP_STOR_S_ALT:
+	case SMX_OP_SREF_S_PRI:
+	case SMX_OP_SREF_S_ALT:
+	case SMX_OP_STOR_I:
+	case SMX_OP_STRB_I:
+	case SMX_OP_ZERO:
+	case SMX_OP_ZERO_S:
+	case SMX_OP_ZERO_ALT:
+	case SMX_OP_INC:
+	case SMX_OP_INC_S:
+	case SMX_OP_INC_ALT:
+	case SMX_OP_DEC:
+	case SMX_OP_DEC_S:
+	case SMX_OP_DEC_ALT:
+	case SMX_OP_SHL_C_ALT:
+	case SMX_OP_CONST:
+	case SMX_OP_CONST_S:
+	case SMX_OP_MOVS:
+	case SMX_OP_FILL:
+	case SMX_OP_BOUNDS:
+	case SMX_OP_HEAP:
+	case SMX_OP_BREAK:
+	case SMX_OP_NOP:
+		return true;
+	}
+	return false;
+}
+
+// Instructions that overwrite alt, besides those handled by FindAddressOperands
+static bool WritesAlt( cell_t op )
+{
+	switch( op )
+	{
+	case SMX_OP_LOAD_ALT:
+	case SMX_OP_LOAD_S_ALT:
+	case SMX_OP_LREF_S_ALT:
+	case SMX_OP_ADDR_ALT:
+	case SMX_OP_LOAD_BOTH:
+	case SMX_OP_LOAD_S_BOTH:
+	case SMX_OP_ZERO_ALT:
+	case SMX_OP_INC_ALT:
+	case SMX_OP_DEC_ALT:
+	case SMX_OP_SHL_C_ALT:
+	case SMX_OP_SWAP_ALT:
+	case SMX_OP_HEAP:
+		return true;
+	}
+	return false;
+}
+
+std::vector<const cell_t*> XrefIndex::FindAddressOperands( SmxFile& smx, const cell_t* start, const cell_t* end )
+{
+	std::vector<const cell_t*> found;
+
+	// Which constant operand each register and pushed cell holds, nullptr for anything else
+	const cell_t* pri = nullptr;
+	const cell_t* alt = nullptr;
+	std::vector<const cell_t*> stack;
+
+	auto Use = [&]( const cell_t* operand ) {
+		if( operand )
+			found.push_back( operand );
+	};
+	auto Pop = [&]() -> const cell_t* {
+		if( stack.empty() )
+			return nullptr;
+		const cell_t* operand = stack.back();
+		stack.pop_back();
+		return operand;
+	};
+	// Arguments are pushed last to first, so the first one is on top. skip leaves out the count
+	// pushed on top of them
+	auto UseArgs = [&]( const SmxFunctionSignature* sig, cell_t nargs, size_t skip ) {
+		for( cell_t i = 0; sig && i < nargs && skip + i < stack.size(); i++ )
+		{
+			if( IsAddressParam( *sig, i ) )
+				Use( stack[stack.size() - 1 - skip - i] );
+		}
+	};
+
+	const cell_t* instr = start;
+	while( instr < end )
+	{
+		const cell_t* next = SmxInstrInfo::Next( instr, end );
+		if( !next )
+			break;
+
+		const auto& info = SmxInstrInfo::Get( instr[0] );
+		switch( instr[0] )
+		{
+		case SMX_OP_CONST_PRI:
+			pri = instr + 1;
+			break;
+		case SMX_OP_CONST_ALT:
+			alt = instr + 1;
+			break;
+		case SMX_OP_MOVE_PRI:
+			pri = alt;
+			break;
+		case SMX_OP_MOVE_ALT:
+			alt = pri;
+			break;
+		case SMX_OP_XCHG:
+			std::swap( pri, alt );
+			break;
+		case SMX_OP_SWAP_PRI:
+			if( !stack.empty() )
+				std::swap( pri, stack.back() );
+			else
+				pri = nullptr;
+			break;
+
+		case SMX_OP_PUSH_PRI:
+			stack.push_back( pri );
+			break;
+		case SMX_OP_PUSH_ALT:
+			stack.push_back( alt );
+			break;
+		case SMX_OP_PUSH_C:
+		case SMX_OP_PUSH2_C:
+		case SMX_OP_PUSH3_C:
+		case SMX_OP_PUSH4_C:
+		case SMX_OP_PUSH5_C:
+			for( int param = 1; param <= info.num_params; param++ )
+				stack.push_back( instr + param );
+			break;
+		case SMX_OP_PUSH:
+		case SMX_OP_PUSH2:
+		case SMX_OP_PUSH3:
+		case SMX_OP_PUSH4:
+		case SMX_OP_PUSH5:
+		case SMX_OP_PUSH_S:
+		case SMX_OP_PUSH2_S:
+		case SMX_OP_PUSH3_S:
+		case SMX_OP_PUSH4_S:
+		case SMX_OP_PUSH5_S:
+		case SMX_OP_PUSH_ADR:
+		case SMX_OP_PUSH2_ADR:
+		case SMX_OP_PUSH3_ADR:
+		case SMX_OP_PUSH4_ADR:
+		case SMX_OP_PUSH5_ADR:
+			stack.insert( stack.end(), info.num_params, nullptr );
+			break;
+		case SMX_OP_POP_PRI:
+			pri = Pop();
+			break;
+		case SMX_OP_POP_ALT:
+			alt = Pop();
+			break;
+		case SMX_OP_STACK:
+			// Only frees are followed (the arguments of sysreq.c), the room made for locals is never
+			// pushed to or popped from
+			for( cell_t i = 0; i < instr[1] / (cell_t)sizeof( cell_t ) && !stack.empty(); i++ )
+				stack.pop_back();
+			break;
+
+		// The base in alt, the index in pri
+		case SMX_OP_LIDX:
+		case SMX_OP_IDXADDR:
+			Use( alt );
+			pri = nullptr;
+			break;
+		case SMX_OP_LOAD_I:
+		case SMX_OP_LODB_I:
+			Use( pri );
+			pri = nullptr;
+			break;
+		case SMX_OP_STOR_I:
+		case SMX_OP_STRB_I:
+		case SMX_OP_FILL:
+			Use( alt );
+			break;
+		case SMX_OP_INC_I:
+		case SMX_OP_DEC_I:
+			Use( pri );
+			break;
+		case SMX_OP_MOVS:
+			Use( pri );
+			Use( alt );
+			break;
+
+		case SMX_OP_CALL:
+		{
+			// The argument count is pushed last, the callee pops it along with the arguments
+			const cell_t* count = stack.empty() ? nullptr : stack.back();
+			if( !count )
+			{
+				stack.clear();
+			}
+			else
+			{
+				SmxFunction* callee = smx.FindFunctionAt( instr[1] );
+				bool known = callee && callee->pcode_start == instr[1];
+				UseArgs( known ? &callee->signature() : nullptr, *count, 1 );
+				for( cell_t i = 0; i <= *count && !stack.empty(); i++ )
+					stack.pop_back();
+			}
+			pri = alt = nullptr;
+			break;
+		}
+		case SMX_OP_SYSREQ_C:
+		{
+			// Same as a call, but the caller frees the arguments afterwards with stack
+			const cell_t* count = stack.empty() ? nullptr : stack.back();
+			SmxNative* native = smx.FindNativeByIndex( instr[1] );
+			if( count )
+				UseArgs( native ? &native->signature() : nullptr, *count, 1 );
+			pri = alt = nullptr;
+			break;
+		}
+		case SMX_OP_SYSREQ_N:
+		{
+			SmxNative* native = smx.FindNativeByIndex( instr[1] );
+			UseArgs( native ? &native->signature() : nullptr, instr[2], 0 );
+			for( cell_t i = 0; i < instr[2] && !stack.empty(); i++ )
+				stack.pop_back();
+			pri = alt = nullptr;
+			break;
+		}
+
+		// Registers aren't followed past anything that can jump, the pushes are since arguments can
+		// contain conditions
+		case SMX_OP_PROC:
+			stack.clear();
+			pri = alt = nullptr;
+			break;
+		case SMX_OP_RETN:
+		case SMX_OP_JUMP:
+		case SMX_OP_JZER:
+		case SMX_OP_JNZ:
+		case SMX_OP_JEQ:
+		case SMX_OP_JNEQ:
+		case SMX_OP_JSLESS:
+		case SMX_OP_JSLEQ:
+		case SMX_OP_JSGRTR:
+		case SMX_OP_JSGEQ:
+		case SMX_OP_SWITCH:
+		case SMX_OP_CASETBL:
+			pri = alt = nullptr;
+			break;
+
+		default:
+			if( !KeepsPri( instr[0] ) )
+				pri = nullptr;
+			if( WritesAlt( instr[0] ) )
+				alt = nullptr;
+			break;
+		}
+
+		instr = next;
+	}
+
+	std::sort( found.begin(), found.end() );
+	found.erase( std::unique( found.begin(), found.end() ), found.end() );
+	return found;
+}
+
+std::string XrefIndex::FunctionName( cell_t func )
+{
+	SmxFunction* function = smx_->FindFunctionAt( func );
+	if( function && function->pcode_start == func && function->name )
+		return function->name;
+	return "func_" + std::to_string( func );
+}
+
+std::string XrefIndex::TargetName( const Xref& xref )
+{
+	switch( xref.kind )
+	{
+	case Kind::CALL:
+		return FunctionName( xref.target );
+	case Kind::NATIVE:
+		if( SmxNative* native = smx_->FindNativeByIndex( xref.target ) )
+			return native->name;
+		return "native_" + std::to_string( xref.target );
+	case Kind::GLOBAL_READ:
+	case Kind::GLOBAL_WRITE:
+	case Kind::GLOBAL_ADDR:
+		if( SmxVariable* var = smx_->FindGlobalAt( xref.target ) )
+			return var->name;
+		return "global_" + std::to_string( xref.target );
+	case Kind::DATA_REF:
+		return std::string( (const char*)smx_->data( xref.target ), smx_->StringLength( xref.target ) );
+	}
+	return "";
+}
+
+void XrefIndex::Print( OutputFormat format )
+{
+	static const char* kind_names[] = { "call", "native", "read", "write", "address", "data" };
+	static const char* kind_headers[] = { "calls to", "calls to native", "reads of", "writes to", "address of", "references to" };
+
+	// Lookups of the referencing function go through a linear search, only do them once per function
+	std::unordered_map<cell_t, std::string> func_names;
+	auto FuncName = [&]( cell_t func ) -> const std::string& {
+		auto it = func_names.find( func );
+		if( it == func_names.end() )
+			it = func_names.emplace( func, FunctionName( func ) ).first;
+		return it->second;
+	};
+
+	for( size_t i = 0; i < by_target_.size(); )
+	{
+		const Xref& first = by_target_[i];
+		std::string target_name = TargetName( first );
+
+		if( format == OutputFormat::TEXT )
+		{
+			std::cout << kind_headers[(int)first.kind] << ' ';
+			if( first.kind == Kind::DATA_REF )
+				std::cout << JsonWriter().String( target_name ).str() << " (data 0x" << std::hex << first.target << std::dec << ')';
+			else
+				std::cout << target_name;
+			std::cout << '\n';
+		}
+
+		for( ; i < by_target_.size() && by_target_[i].kind == first.kind && by_target_[i].target == first.target; i++ )
+		{
+			const Xref& xref = by_target_[i];
+			if( format == OutputFormat::NDJSON )
+			{
+				JsonWriter json;
+				json.BeginObject()
+					.Key( "kind" ).String( kind_names[(int)xref.kind] )
+					.Key( "address" ).Number( (int64_t)xref.addr )
+					.Key( "function" ).String( FuncName( xref.func ) )
+					.Key( "target" ).Number( (int64_t)xref.target )
+					.Key( "name" ).String( target_name )
+					.EndObject();
+				std::cout << json.str() << '\n';
+			}
+			else
+			{
+				std::cout << '\t' << FuncName( xref.func ) << " at 0x" << std::hex << xref.addr << std::dec << '\n';
+			}
+		}
+	}
+	std::cout.flush();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "smx-file.h"
+#include "decompiler-options.h"
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Cross references for a whole file, found with a single pass over its code without lifting or
+// decompiling anything. Operands are taken as they appear in the instructions:
+//   CALL         target = address of the called function
+//   NATIVE       target = native index (sysreq.c/sysreq.n)
+//   GLOBAL_READ  target = data address loaded or pushed
+//   GLOBAL_WRITE target = data address stored to, zeroed, incremented or decremented
+//   GLOBAL_ADDR  target = data address of a global taken by a constant that is used as an address
+//                (see FindAddressOperands)
+//   DATA_REF     target = data address of a constant that points at the start of a possible string
+class XrefIndex
+{
+public:
+	enum class Kind : uint8_t
+	{
+		CALL,
+		NATIVE,
+		GLOBAL_READ,
+		GLOBAL_WRITE,
+		GLOBAL_ADDR,
+		DATA_REF
+	};
+
+	struct Xref
+	{
+		Kind kind;
+		cell_t addr;   // Address of the referencing instruction
+		cell_t func;   // Start of the function the instruction is in
+		cell_t target;
+	};
+
+	using Range = std::pair<const Xref*, const Xref*>;
+
+	explicit XrefIndex( SmxFile& smx );
+
+	// All references of the kind to target, in order of address
+	Range To( Kind kind, cell_t target ) const;
+	// All references made by the function starting at func, in order of address
+	Range From( cell_t func ) const;
+
+	// Start of every function in the code, in order of address. Also has the ones that aren't in
+	// any table and would only be discovered while decompiling
+	size_t num_functions() const { return functions_.size(); }
+	cell_t function( size_t index ) const { return functions_[index]; }
+
+	size_t num_xrefs() const { return by_addr_.size(); }
+	const Xref& xref( size_t index ) const { return by_addr_[index]; }
+
+	// Name of the function starting at func, unnamed functions are named after their address
+	std::string FunctionName( cell_t func );
+	// Name of what the reference points at, or the string itself for DATA_REF
+	std::string TargetName( const Xref& xref );
+
+	// Prints every reference grouped by what is referenced to stdout
+	void Print( OutputFormat format );
+
+	// Operands of constant instructions (const.pri, push.c, ...) between start and end whose value is
+	// used as an address rather than a number: passed for a by-reference, array or variadic parameter,
+	// or dereferenced or indexed through pri/alt. Followed through the registers and pushes within a
+	// straight run of code only, sorted by address
+	static std::vector<const cell_t*> FindAddressOperands( SmxFile& smx, const cell_t* start, const cell_t* end );
+private:
+	void Scan();
+	void Add( Kind kind, cell_t addr, cell_t func, cell_t target );
+private:
+	SmxFile* smx_;
+	std::vector<cell_t> functions_;
+	std::vector<Xref> by_addr_;   // Scan order, so grouped by function
+	std::vector<Xref> by_target_; // Sorted by kind, then target, then address
+};